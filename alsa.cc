@@ -111,13 +111,8 @@ and if you want to select card 3 and device 0 on that card, please use:
             "   output_sample_rate: %d\n",
             actual_sample_rate_, expected_sample_rate_);
 
-    float min_freq = std::min(actual_sample_rate_, expected_sample_rate_);
-    float lowpass_cutoff = 0.99 * 0.5 * min_freq;
-
-    int32_t lowpass_filter_width = 6;
-    resampler_ = std::make_unique<LinearResample>(
-        actual_sample_rate_, expected_sample_rate_, lowpass_cutoff,
-        lowpass_filter_width);
+    resampler_ =
+        LinearResample::Create(actual_sample_rate_, expected_sample_rate_);
   } else {
     fprintf(stderr, "Current sample rate: %d\n", actual_sample_rate_);
   }
@@ -1,9 +1,10 @@
 #include "asr.h"
+#include "batch_sense_voice.h"
 #include "iostream"
+#include "clog.h"
 #include <samplerate.h>
 
-static std::vector<float> resample(const std::vector<float> &input,
-                                   int inputRate)
+std::vector<float> resample(const std::vector<float> &input, int inputRate)
 // int outputRate,
 // int converterType)
 {
@@ -41,16 +42,29 @@ static std::vector<float> resample(const std::vector<float> &input,
 }
 
 Asr::Asr(const std::string &asr_onnx, const std::string &tokens,
-         const std::string &vad_onnx) {
+         const std::string &vad_onnx, int queue_size, int recog_threads)
+    : Asr(BatchSenseVoice::shared(asr_onnx, tokens), vad_onnx, queue_size,
+          recog_threads) {}
+
+Asr::Asr(std::shared_ptr<Recognizer> recognizer, const std::string &vad_onnx,
+         int queue_size, int recog_threads)
+    : _recognizer(std::move(recognizer)), _segments(queue_size) {
   _running = true;
-  _sence_voice = std::make_unique<SenseVoice>(asr_onnx, tokens);
   _vad = std::make_unique<SileroVAD>(vad_onnx);
+  _feature = _recognizer->create_feature();
+  for (int i = 0; i < recog_threads; ++i) {
+    _recog_ths.emplace_back(&Asr::recog_loop, this);
+  }
   _th = std::thread(&Asr::run, this);
 }
 
 Asr::~Asr() {
   _running = false;
   _th.join();
+  // run() closes the queue on exit, the workers drain what is left
+  for (auto &th : _recog_ths) {
+    th.join();
+  }
 }
 
 void Asr::push_data(const std::vector<float> &data, int inputRate) {
@@ -62,11 +76,56 @@ void Asr::push_data(const std::vector<float> &data, int inputRate) {
 }
 
 void Asr::wait_finish() {
-  std::unique_lock<std::mutex> lk(_mx);
-  _cv.wait(lk, [this] { return _deque.size() <= 512; });
+  {
+    std::unique_lock<std::mutex> lk(_mx);
+    _cv.wait(lk, [this] { return _deque.size() <= 512; });
+  }
+  {
+    std::unique_lock<std::mutex> lk(_recog_mx);
+    _recog_cv.wait(lk, [this] { return _inflight == 0; });
+  }
   _running.store(true);
 }
 
+void Asr::submit(std::vector<float> &&feats) {
+  {
+    std::lock_guard<std::mutex> lk(_recog_mx);
+    ++_inflight;
+  }
+  // Never block the vad thread: if recognition falls behind, drop the oldest
+  // pending segment so that the newest speech is still recognized.
+  while (!_segments.try_push(feats)) {
+    std::vector<float> dropped;
+    if (_segments.try_pop(dropped)) {
+      PLOGE << "asr queue full, drop segment of "
+            << dropped.size() / _feature->FeatureDim() << " frames";
+      std::lock_guard<std::mutex> lk(_recog_mx);
+      --_inflight;
+    }
+  }
+}
+
+void Asr::finish_segment() {
+  // only the last few fbank frames are left to compute here
+  _feature->InputFinished();
+  submit(std::move(_feature->Feats()));
+  _feature->Reset();
+  _in_speech = false;
+}
+
+void Asr::recog_loop() {
+  std::vector<float> feats;
+  while (_segments.pop(feats)) {
+    auto result = _recognizer->recog_feats(std::move(feats));
+    if (_onAsr) {
+      _onAsr(result);
+    }
+    std::lock_guard<std::mutex> lk(_recog_mx);
+    --_inflight;
+    _recog_cv.notify_all();
+  }
+}
+
 void Asr::run() {
   int idx = 0;
   while (_running.load()) {
@@ -92,25 +151,20 @@ void Asr::run() {
       std::transform(data.begin(), data.end(), data.begin(),
                      [](float x) { return x * 32768.0f; });
       if (trigger == "start") { // detect voice
-        _curWav.insert(_curWav.end(), data.begin(), data.end());
+        _in_speech = true;
+        _feature->AcceptWaveform(data.data(), data.size());
       } else if (trigger == "end") { // detect silence
-        _curWav.insert(_curWav.end(), data.begin(), data.end());
-        auto result = _sence_voice->recog(_curWav);
-        if (_onAsr) {
-          _onAsr(result);
-        }
-        _curWav.clear();
-      } else if (_curWav.size() > 0) {
-        _curWav.insert(_curWav.end(), data.begin(), data.end());
+        _feature->AcceptWaveform(data.data(), data.size());
+        finish_segment();
+      } else if (_in_speech) {
+        _feature->AcceptWaveform(data.data(), data.size());
       }
     }
   }
 
-  if (_curWav.size() > 0) {
-    auto result = _sence_voice->recog(_curWav);
-    if (_onAsr) {
-      _onAsr(result);
-    }
+  if (_in_speech) {
+    finish_segment();
   }
+  _segments.close();
   std::cout << "Asr run exit" << std::endl;
 }
@@ -3,14 +3,20 @@
 #include <memory>
 #include <deque>
 #include <atomic>
+#include <functional>
 #include <mutex>
 #include <thread>
-#include "sense_voice.h"
+#include "bounded_queue.h"
+#include "config.h"
+#include "recognizer.h"
 #include "vad.h"
 #include <condition_variable>
 
 using silero_vad::SileroVAD;
 
+// input at inputRate -> 16kHz with libsamplerate, as push_data() does
+std::vector<float> resample(const std::vector<float> &input, int inputRate);
+
 struct AsrMsg {
     std::string type = "";
     std::string msg = "";
@@ -18,20 +24,42 @@ struct AsrMsg {
 
 class Asr {
     public:
-        Asr(const std::string& asr_onnx, const std::string& tokens, const std::string& vad_onnx);
+        // recognizer is shared by every pipeline of the process and must be
+        // thread-safe, e.g. BatchSenseVoice::shared(), which batches the
+        // segments of all streams against one model instance
+        Asr(std::shared_ptr<Recognizer> recognizer, const std::string& vad_onnx,
+            int queue_size = CONFIG::asr_queue_size,
+            int recog_threads = CONFIG::asr_recog_threads);
+        Asr(const std::string& asr_onnx, const std::string& tokens, const std::string& vad_onnx,
+            int queue_size = CONFIG::asr_queue_size,
+            int recog_threads = CONFIG::asr_recog_threads);
         ~Asr();
         void push_data(const std::vector<float>& data, int sampleRate);
         void run();
         std::atomic<bool> _running;
         std::thread _th;
+        // called from a recognition thread, not from the vad thread
         std::function<void(const std::string& asr)> _onAsr;
         void wait_finish();
-        std::unique_ptr<SenseVoice> _sence_voice;
+        std::shared_ptr<Recognizer> _recognizer;
 
     private:
+        void finish_segment();
+        void submit(std::vector<float>&& feats);
+        void recog_loop();
+
         std::unique_ptr<SileroVAD> _vad;
         std::deque<float> _deque;
-        std::vector<float> _curWav;
+        // features of the current segment, computed while it is spoken
+        std::unique_ptr<OnlineSenseVoiceFeature> _feature;
+        bool _in_speech = false;
         std::mutex _mx;
         std::condition_variable _cv;
+
+        // features of finished segments, vad thread -> recognition threads
+        BoundedQueue<std::vector<float>> _segments;
+        std::vector<std::thread> _recog_ths;
+        int _inflight = 0; // queued or being recognized, guarded by _recog_mx
+        std::mutex _recog_mx;
+        std::condition_variable _recog_cv;
 };
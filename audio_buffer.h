@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// 64-byte aligned float samples. resize() never shrinks the allocation and
+// does not initialise or, when it has to grow, preserve the samples: the
+// buffer is meant to be filled right after.
+class AudioBuffer {
+public:
+  static constexpr size_t kAlignment = 64;
+
+  AudioBuffer() = default;
+  AudioBuffer(const AudioBuffer &) = delete;
+  AudioBuffer &operator=(const AudioBuffer &) = delete;
+  ~AudioBuffer() { std::free(_data); }
+
+  void resize(size_t n) {
+    if (n > _capacity) {
+      std::free(_data);
+      size_t bytes = (n * sizeof(float) + kAlignment - 1) / kAlignment *
+                     kAlignment;
+      _data = static_cast<float *>(std::aligned_alloc(kAlignment, bytes));
+      if (!_data) {
+        _capacity = _size = 0;
+        throw std::bad_alloc();
+      }
+      _capacity = bytes / sizeof(float);
+    }
+    _size = n;
+  }
+
+  float *data() { return _data; }
+  const float *data() const { return _data; }
+  // raw view used when the samples arrive as bytes
+  int8_t *bytes() { return reinterpret_cast<int8_t *>(_data); }
+  size_t size() const { return _size; }
+  size_t capacity() const { return _capacity; }
+
+private:
+  float *_data = nullptr;
+  size_t _size = 0;
+  size_t _capacity = 0;
+};
+
+// Process wide free list of AudioBuffers. A buffer handed out by acquire()
+// goes back to the pool when its last reference is dropped, so steady
+// traffic stops hitting the allocator after warm up.
+class AudioBufferPool {
+public:
+  static AudioBufferPool &get() {
+    static AudioBufferPool *inst = new AudioBufferPool; // outlives all users
+    return *inst;
+  }
+
+  std::shared_ptr<AudioBuffer> acquire(size_t num_samples) {
+    AudioBuffer *buf = nullptr;
+    {
+      std::lock_guard<std::mutex> lk(_mx);
+      // prefer a buffer that does not need to grow
+      for (size_t i = _free.size(); i-- > 0;) {
+        if (_free[i]->capacity() >= num_samples) {
+          buf = _free[i];
+          _free.erase(_free.begin() + i);
+          break;
+        }
+      }
+      if (!buf && !_free.empty()) {
+        buf = _free.back();
+        _free.pop_back();
+      }
+    }
+    if (!buf) {
+      buf = new AudioBuffer;
+    }
+    try {
+      buf->resize(num_samples);
+    } catch (...) {
+      delete buf;
+      throw;
+    }
+    return std::shared_ptr<AudioBuffer>(
+        buf, [this](AudioBuffer *b) { release(b); });
+  }
+
+private:
+  static constexpr size_t kMaxFree = 64;
+
+  void release(AudioBuffer *buf) {
+    {
+      std::lock_guard<std::mutex> lk(_mx);
+      if (_free.size() < kMaxFree) {
+        _free.push_back(buf);
+        return;
+      }
+    }
+    delete buf;
+  }
+
+  std::mutex _mx;
+  std::vector<AudioBuffer *> _free;
+};
@@ -8,25 +8,23 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 
-#include "kaldi-native-fbank/csrc/feature-fbank.h"
-#include "kaldi-native-fbank/csrc/feature-window.h"
-#include "kaldi-native-fbank/csrc/mel-computations.h"
-#include "kaldi-native-fbank/csrc/online-feature.h"
-
 // for time cost
 #include "util.h"
 
 void BatchSenseVoice::init(const std::string &model_path,
-                           const std::string &tokens_path) {
+                           const std::string &tokens_path,
+                           const std::string &name) {
+  name_ = name;
   auto *inst = OnnxEngine::get_inst();
   auto ptr = std::make_unique<OnnxSession>(model_path);
   ptr->init();
 
   std::map<std::string, std::string> meta;
   ptr->getCustomMetadataMap(meta);
-  inst->addModel("SenseVoice", std::move(ptr));
+  inst->addModel(name_, std::move(ptr));
 
   auto get_int32 = [&meta](const std::string &key) { return stoi(meta[key]); };
 
@@ -64,38 +62,86 @@ void BatchSenseVoice::init(const std::string &model_path,
 
 BatchSenseVoice::~BatchSenseVoice() {}
 
+std::shared_ptr<BatchSenseVoice>
+BatchSenseVoice::shared(const std::string &model_path,
+                        const std::string &tokens_path) {
+  static std::mutex mutex;
+  static std::map<std::string, std::shared_ptr<BatchSenseVoice>> instances;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &inst = instances[model_path];
+  if (!inst) {
+    inst = std::make_shared<BatchSenseVoice>();
+    // keyed by path so it can not clobber the server's "SenseVoice" session
+    inst->init(model_path, tokens_path, model_path);
+  }
+  return inst;
+}
+
+void BatchSenseVoice::set_cache(size_t max_bytes) {
+  cache_ = std::make_unique<TranscriptCache>(max_bytes);
+}
+
+TranscriptCache::Key BatchSenseVoice::cache_key(const SampleHasher &audio,
+                                                int32_t sample_rate,
+                                                bool trimmed) const {
+  TranscriptCache::Key key;
+  key.audio = audio.Digest();
+  key.num_samples = audio.NumSamples();
+  // the inputs of make_request() besides the features, and how the
+  // features were made
+  key.options = static_cast<uint64_t>(sample_rate) << 32 |
+                static_cast<uint64_t>(language_ & 0xFFF) << 20 |
+                static_cast<uint64_t>(with_itn_ & 0x7FFFF) << 1 | trimmed;
+  return key;
+}
+
 std::string BatchSenseVoice::recog(const std::vector<float> &data) {
-  Timer cost("AsrCost");
-  // extract fbank
-  knf::FbankOptions opts;
-  opts.frame_opts.dither = 0;
-  opts.frame_opts.snip_edges = false;
-  opts.frame_opts.window_type = "hamming";
-  opts.frame_opts.samp_freq = 16000;
-  opts.mel_opts.num_bins = 80;
-
-  knf::OnlineFbank fbank(opts);
-  fbank.AcceptWaveform(16000, data.data(), data.size());
-  fbank.InputFinished();
-
-  int32_t n = fbank.NumFramesReady();
-  std::vector<float> feats;
-
-  for (int i = 0; i + window_size_ <= n; i += window_shift_) {
-    for (int k = i * 80; k < (i + window_size_) * 80; k++) {
-      double value = fbank.GetFrame(k / 80)[k % 80];
-      feats.push_back((value + neg_mean_[k % 560]) * inv_stddev_[k % 560]);
+  TranscriptCache::Key key;
+  std::string asr;
+  if (cache_) {
+    SampleHasher hasher;
+    hasher.Update(data.data(), data.size());
+    key = cache_key(hasher, 16000, false);
+    if (cache_->Get(key, &asr)) {
+      return asr;
     }
   }
+
+  // extract fbank
+  auto feature = create_feature();
+  feature->AcceptWaveform(data.data(), data.size());
+  feature->InputFinished();
+  asr = recog_feats(std::move(feature->Feats()));
+  if (cache_) {
+    cache_->Put(key, asr);
+  }
+  return asr;
+}
+
+std::unique_ptr<OnlineSenseVoiceFeature>
+BatchSenseVoice::create_feature() const {
+  return std::make_unique<OnlineSenseVoiceFeature>(window_size_, window_shift_,
+                                                   neg_mean_, inv_stddev_);
+}
+
+std::string BatchSenseVoice::recog_feats(std::vector<float> &&feats) {
+  Timer cost("AsrCost");
+  auto req = make_request(std::move(feats));
+  OnnxEngine::get_inst()->request(name_, req);
+  return decode(*req);
+}
+
+std::shared_ptr<Request>
+BatchSenseVoice::make_request(std::vector<float> &&feats) const {
   auto req = std::make_shared<Request>();
   // feature bank
   ArrayWithShape bank;
   bank.isInt = false;
-  bank.data_float = feats;
   int32_t feat_dim = 80 * window_size_;
   int64_t num_frames = feats.size() / feat_dim;
+  bank.data_float = std::move(feats);
   bank.shape = {num_frames, feat_dim};
-  req->_input_arrays.push_back(bank);
+  req->_input_arrays.push_back(std::move(bank));
   //
   ArrayWithShape length;
   length.isInt = true;
@@ -105,7 +151,7 @@ std::string BatchSenseVoice::recog(const std::vector<float> &data) {
   //
   ArrayWithShape lang;
   lang.isInt = true;
-  lang.data_int32.push_back(0);
+  lang.data_int32.push_back(language_);
   lang.shape.push_back(1);
   req->_input_arrays.push_back(lang);
   //
@@ -114,25 +160,27 @@ std::string BatchSenseVoice::recog(const std::vector<float> &data) {
   text_norm.data_int32.push_back(with_itn_);
   text_norm.shape.push_back(1);
   req->_input_arrays.push_back(text_norm);
+  return req;
+}
 
-  // req._feats.swap(feats);
-  OnnxEngine::get_inst()->request("SenseVoice", req);
-
+std::string BatchSenseVoice::decode(const Request &req) const {
   // convert to text
   auto asr = std::string("");
-  if (req->_output_arrays) {
-    auto &val = req->_output_arrays->at(0);
-    int output_index = req->_output_index;
+  if (req._output_arrays) {
+    auto &val = req._output_arrays->at(0);
+    int output_index = req._output_index;
 
     auto info = val.GetTensorTypeAndShapeInfo();
     std::vector<int64_t> shape = info.GetShape();
-    std::string shape_info;
-    shape_info += "shape: ";
-    for (auto s : shape) {
-      shape_info += std::to_string(s);
-      shape_info += " ";
+    if (CLogger::Enabled(PLogLevel::DEBUG)) {
+      std::string shape_info;
+      shape_info += "shape: ";
+      for (auto s : shape) {
+        shape_info += std::to_string(s);
+        shape_info += " ";
+      }
+      PLOGD << shape_info;
     }
-    PLOGI << shape_info;
     size_t element_count = info.GetElementCount() / shape[0];
 
 #if 0
@@ -158,7 +206,11 @@ std::string BatchSenseVoice::recog(const std::vector<float> &data) {
     std::vector<int64_t> final = unique_consecutive<int64_t>(result);
     for (const auto f : final) {
       if (f > 0 and f < 24884) {
-        asr += tokens_[std::to_string(f)];
+        // recog() runs on many threads, never insert into tokens_ here
+        auto it = tokens_.find(std::to_string(f));
+        if (it != tokens_.end()) {
+          asr += it->second;
+        }
       }
     }
     if (asr.size() > 0) {
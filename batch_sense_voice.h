@@ -1,25 +1,56 @@
 #pragma once
 #include "onnx_engine.h"
+#include "recognizer.h"
+#include "transcript_cache.h"
 #include <map>
+#include <memory>
 #include <onnxruntime_cxx_api.h>
 #include <string>
 #include <vector>
 
-class BatchSenseVoice {
+class BatchSenseVoice : public Recognizer {
 public:
   BatchSenseVoice() {};
-  void init(const std::string &model_path, const std::string &token_path);
+  void init(const std::string &model_path, const std::string &token_path,
+            const std::string &name = "SenseVoice");
   ~BatchSenseVoice();
 
-  std::string recog(const std::vector<float> &wav);
+  // One instance per model for the whole process, so that every Asr
+  // pipeline batches its segments against the same OnnxSession.
+  static std::shared_ptr<BatchSenseVoice> shared(const std::string &model_path,
+                                                 const std::string &token_path);
+
+  std::string recog(const std::vector<float> &wav) override;
+  std::string recog_feats(std::vector<float> &&feats) override;
+  std::unique_ptr<OnlineSenseVoiceFeature> create_feature() const override;
+
+  // The two halves of recog_feats() around the engine, for callers that
+  // submit with OnnxEngine::request_async() and decode on their own threads
+  std::shared_ptr<Request> make_request(std::vector<float> &&feats) const;
+  std::string decode(const Request &req) const;
+
+  // Remember transcripts of recog() and of callers that look up cache()
+  // themselves, up to max_bytes. Call before serving.
+  void set_cache(size_t max_bytes);
+  TranscriptCache *cache() { return cache_.get(); }
+  // audio is the 16kHz (or sample_rate, before resampling) input; trimmed
+  // tells whether silence was trimmed before the features
+  TranscriptCache::Key cache_key(const SampleHasher &audio,
+                                 int32_t sample_rate, bool trimmed) const;
+
+  std::string name_;
 
   int32_t window_size_;
   int32_t window_shift_;
   int32_t with_itn_;
   int32_t without_itn_;
+  int32_t language_ = 0; // auto
 
   std::map<std::string, int32_t> lang_id_;
   std::vector<float> neg_mean_;
   std::vector<float> inv_stddev_;
   std::map<std::string, std::string> tokens_;
+
+private:
+  std::unique_ptr<TranscriptCache> cache_;
 };
@@ -0,0 +1,396 @@
+// Batching policy simulator: replays synthetic arrivals straight into the
+// SenseVoice OnnxSession, without the websocket and the feature stages in
+// the way, and reports per arrival process and BatchPolicy:
+//
+//   ./batch_sim [--audio-dir scripts/audios | --manifest wavs.txt]
+//       [--arrivals poisson,bursty,diurnal] [--rate 10] [--duration 30]
+//       [--warmup 5] [--policy 0:0 --policy 8:10 ...] > policies.json
+//
+// A policy is max_batch:max_wait_ms, 0:0 being the default of running
+// whatever is queued. Utterance lengths are drawn from the files, whose
+// features are computed once up front. Every run replays the same arrival
+// times and utterances for a given process, so the policies see identical
+// load. Latency runs from the scheduled arrival to the outputs being set;
+// mean batch size and padding come from the session's BatchMetrics, as
+// exported on /metrics. Needs CONFIG::asr_onnx and CONFIG::tokens.
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asr.h"
+#include "batch_sense_voice.h"
+#include "config.h"
+#include "onnx_engine.h"
+#include "util.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<std::string> ListWavs(const std::string &dir) {
+  std::vector<std::string> files;
+  if (DIR *d = opendir(dir.c_str())) {
+    while (dirent *e = readdir(d)) {
+      std::string name = e->d_name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) {
+        files.push_back(dir + "/" + name);
+      }
+    }
+    closedir(d);
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// first field of every line
+std::vector<std::string> ReadManifest(const std::string &path) {
+  std::vector<std::string> files;
+  std::ifstream is(path);
+  std::string line;
+  while (std::getline(is, line)) {
+    std::istringstream fields(line);
+    std::string file;
+    if (fields >> file && file[0] != '#') {
+      files.push_back(file);
+    }
+  }
+  return files;
+}
+
+struct Utterance {
+  double seconds;
+  std::vector<float> feats;
+};
+
+// Arrival times in seconds from the start, at a mean of rate per second:
+//   poisson  exponential gaps
+//   bursty   on/off modulated Poisson, 4x the rate for 1s bursts taking a
+//            fifth of the time and a quarter of it in between
+//   diurnal  a day squeezed into the run, rate * (1 + 0.8 sin), by thinning
+bool Arrivals(const std::string &kind, double rate, double duration,
+              std::mt19937_64 &rng, std::vector<double> *out) {
+  std::uniform_real_distribution<double> uniform(0, 1);
+  auto gap = [&rng](double r) {
+    return std::exponential_distribution<double>(r)(rng);
+  };
+  out->clear();
+  if (kind == "poisson") {
+    for (double t = gap(rate); t < duration; t += gap(rate)) {
+      out->push_back(t);
+    }
+  } else if (kind == "bursty") {
+    const double burst = 1.0, quiet = 4.0; // mean state durations
+    bool on = false;
+    double t = 0, state_end = gap(1 / quiet);
+    while (t < duration) {
+      double next = t + gap(on ? rate * 4 : rate / 4);
+      if (next >= state_end) {
+        // memoryless, so the arrival is redrawn after the switch
+        t = state_end;
+        on = !on;
+        state_end = t + gap(1 / (on ? burst : quiet));
+      } else if ((t = next) < duration) {
+        out->push_back(t);
+      }
+    }
+  } else if (kind == "diurnal") {
+    const double peak = rate * 1.8;
+    for (double t = gap(peak); t < duration; t += gap(peak)) {
+      double r = rate * (1 + 0.8 * std::sin(2 * M_PI * t / duration));
+      if (uniform(rng) * peak < r) {
+        out->push_back(t);
+      }
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// What the session's BatchMetrics held at some point
+struct BatchCounts {
+  uint64_t batches = 0;
+  double size_sum = 0;
+  double padding_sum = 0;
+  double run_sum = 0;
+
+  static BatchCounts Of(const BatchMetrics &m) {
+    BatchCounts c;
+    for (size_t i = 0; i <= m.size.bounds().size(); ++i) {
+      c.batches += m.size.count(i);
+    }
+    c.size_sum = m.size.sum();
+    c.padding_sum = m.padding.sum();
+    c.run_sum = m.run_seconds.sum();
+    return c;
+  }
+};
+
+nlohmann::json Percentiles(std::vector<double> v, double scale) {
+  nlohmann::json j;
+  if (v.empty()) {
+    return j;
+  }
+  std::sort(v.begin(), v.end());
+  auto at = [&v](double q) {
+    size_t rank = static_cast<size_t>(std::ceil(q * v.size()));
+    return v[std::min(v.size() - 1, rank > 0 ? rank - 1 : 0)];
+  };
+  double sum = 0;
+  for (double x : v) {
+    sum += x;
+  }
+  j["mean"] = sum / v.size() * scale;
+  j["p50"] = at(0.5) * scale;
+  j["p90"] = at(0.9) * scale;
+  j["p99"] = at(0.99) * scale;
+  j["p99.9"] = at(0.999) * scale;
+  j["max"] = v.back() * scale;
+  return j;
+}
+
+// One process under one policy; picks are the utterances of the arrivals
+nlohmann::json Run(BatchSenseVoice &model, OnnxSession &session,
+                   const std::vector<Utterance> &utterances,
+                   const std::vector<double> &arrivals,
+                   const std::vector<size_t> &picks, double warmup,
+                   double duration) {
+  size_t n = arrivals.size();
+  std::vector<double> done_at(n); // seconds from start
+  std::mutex mx;
+  std::condition_variable cv;
+  size_t num_done = 0;
+
+  auto start = Clock::now() + std::chrono::milliseconds(100);
+  auto since = [&start](Clock::time_point t) {
+    return std::chrono::duration<double>(t - start).count();
+  };
+  BatchCounts before;
+  bool measuring = false;
+  for (size_t i = 0; i < n; ++i) {
+    auto req =
+        model.make_request(std::vector<float>(utterances[picks[i]].feats));
+    req->_on_done = [&, i] {
+      double t = since(Clock::now());
+      std::lock_guard<std::mutex> lock(mx);
+      done_at[i] = t;
+      if (++num_done == n) {
+        cv.notify_all();
+      }
+    };
+    if (!measuring && arrivals[i] >= warmup) {
+      measuring = true;
+      before = BatchCounts::Of(session._batch_metrics);
+    }
+    std::this_thread::sleep_until(
+        start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(arrivals[i])));
+    session.addReqAsync(req);
+  }
+  {
+    // the session answers every request
+    std::unique_lock<std::mutex> lock(mx);
+    cv.wait(lock, [&] { return num_done == n; });
+  }
+  BatchCounts after = BatchCounts::Of(session._batch_metrics);
+
+  std::vector<double> latency, rtf;
+  double audio = 0, last = duration;
+  for (size_t i = 0; i < n; ++i) {
+    if (arrivals[i] < warmup) {
+      continue;
+    }
+    double seconds = utterances[picks[i]].seconds;
+    latency.push_back(done_at[i] - arrivals[i]);
+    rtf.push_back(latency.back() / seconds);
+    audio += seconds;
+    last = std::max(last, done_at[i]);
+  }
+
+  nlohmann::json j;
+  // until the last result, if the session fell behind the arrivals
+  double window = last - warmup;
+  j["requests"] = latency.size();
+  j["offered_rps"] = latency.size() / (duration - warmup);
+  j["throughput_rps"] = latency.size() / window;
+  j["audio_s_per_s"] = audio / window;
+  j["latency_ms"] = Percentiles(latency, 1e3);
+  j["rtf"] = Percentiles(rtf, 1);
+  uint64_t batches = after.batches - before.batches;
+  if (batches > 0) {
+    j["batches"] = batches;
+    j["mean_batch_size"] = (after.size_sum - before.size_sum) / batches;
+    j["mean_padding"] = (after.padding_sum - before.padding_sum) / batches;
+    j["mean_batch_run_ms"] = (after.run_sum - before.run_sum) / batches * 1e3;
+  }
+  return j;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string audio_dir = "scripts/audios";
+  std::string manifest;
+  std::vector<std::string> processes{"poisson", "bursty", "diurnal"};
+  double rate = 10, duration = 30, warmup = 5;
+  std::vector<BatchPolicy> policies;
+  uint64_t seed = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--audio-dir" && has_value) {
+      audio_dir = argv[++i];
+    } else if (arg == "--manifest" && has_value) {
+      manifest = argv[++i];
+    } else if (arg == "--arrivals" && has_value) {
+      processes = splitString(argv[++i], ',');
+    } else if (arg == "--rate" && has_value) {
+      rate = atof(argv[++i]);
+    } else if (arg == "--duration" && has_value) {
+      duration = atof(argv[++i]);
+    } else if (arg == "--warmup" && has_value) {
+      warmup = atof(argv[++i]);
+    } else if (arg == "--seed" && has_value) {
+      seed = strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--policy" && has_value) {
+      BatchPolicy p;
+      int max_batch = 0;
+      double wait_ms = 0;
+      if (sscanf(argv[++i], "%d:%lf", &max_batch, &wait_ms) < 1 ||
+          max_batch < 0 || wait_ms < 0) {
+        fprintf(stderr, "bad policy %s, expected max_batch:max_wait_ms\n",
+                argv[i]);
+        return 1;
+      }
+      p.max_batch = max_batch;
+      p.max_wait =
+          std::chrono::microseconds(static_cast<int64_t>(wait_ms * 1000));
+      policies.push_back(p);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--audio-dir dir | --manifest file] "
+              "[--arrivals poisson,bursty,diurnal] [--rate per_s] "
+              "[--duration s] [--warmup s] [--seed n] "
+              "[--policy max_batch:max_wait_ms]...\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (rate <= 0 || duration <= warmup) {
+    fprintf(stderr, "need --rate > 0 and --duration > --warmup\n");
+    return 1;
+  }
+  if (policies.empty()) {
+    // as served, capped, and two that wait for fuller batches
+    policies.resize(4);
+    policies[1].max_batch = CONFIG::max_batch;
+    policies[2].max_batch = 8;
+    policies[2].max_wait = std::chrono::milliseconds(20);
+    policies[3].max_batch = 16;
+    policies[3].max_wait = std::chrono::milliseconds(50);
+  }
+  if (!std::ifstream(CONFIG::asr_onnx).good()) {
+    fprintf(stderr, "%s not found, run from the directory with the models\n",
+            CONFIG::asr_onnx.c_str());
+    return 1;
+  }
+
+  BatchSenseVoice model;
+  model.init(CONFIG::asr_onnx, CONFIG::tokens, "batch_sim");
+  OnnxSession &session = *OnnxEngine::get_inst()->session("batch_sim");
+
+  std::vector<std::string> files =
+      manifest.empty() ? ListWavs(audio_dir) : ReadManifest(manifest);
+  std::vector<Utterance> utterances;
+  for (auto &f : files) {
+    int32_t sample_rate = 0;
+    std::vector<float> samples;
+    if (!load_wav_file(f.c_str(), &sample_rate, samples) || samples.empty()) {
+      fprintf(stderr, "failed to read %s\n", f.c_str());
+      continue;
+    }
+    if (sample_rate != 16000) {
+      samples = resample(samples, sample_rate);
+    }
+    for (auto &x : samples) {
+      x *= 32768;
+    }
+    auto feature = model.create_feature();
+    feature->AcceptWaveformAndFinish(samples.data(), samples.size());
+    utterances.push_back(
+        {samples.size() / 16000.0, std::move(feature->Feats())});
+  }
+  if (utterances.empty()) {
+    fprintf(stderr, "no utterances\n");
+    return 1;
+  }
+  // the first run would pay for onnxruntime's lazy initialization
+  model.recog_feats(std::vector<float>(utterances[0].feats));
+
+  fprintf(stderr, "%-8s %-8s %8s %8s %8s %8s %8s %7s %7s\n", "arrivals",
+          "policy", "req/s", "p50 ms", "p90 ms", "p99 ms", "p99.9", "batch",
+          "padding");
+  nlohmann::json runs = nlohmann::json::array();
+  for (auto &process : processes) {
+    std::mt19937_64 rng(seed);
+    std::vector<double> arrivals;
+    if (!Arrivals(process, rate, duration, rng, &arrivals)) {
+      fprintf(stderr, "unknown arrival process %s\n", process.c_str());
+      return 1;
+    }
+    std::uniform_int_distribution<size_t> pick(0, utterances.size() - 1);
+    std::vector<size_t> picks(arrivals.size());
+    for (auto &p : picks) {
+      p = pick(rng);
+    }
+    for (auto &policy : policies) {
+      session.set_batch_policy(policy);
+      nlohmann::json j = Run(model, session, utterances, arrivals, picks,
+                             warmup, duration);
+      double wait_ms = policy.max_wait.count() / 1000.0;
+      j["arrivals"] = process;
+      j["max_batch"] = policy.max_batch;
+      j["max_wait_ms"] = wait_ms;
+
+      auto num = [](const nlohmann::json &o, const char *key) {
+        return o.is_object() ? o.value(key, 0.0) : 0.0;
+      };
+      const nlohmann::json &l = j["latency_ms"];
+      char name[32];
+      snprintf(name, sizeof(name), "%zu:%g", policy.max_batch, wait_ms);
+      fprintf(stderr, "%-8s %-8s %8.2f %8.1f %8.1f %8.1f %8.1f %7.2f %7.3f\n",
+              process.c_str(), name, num(j, "throughput_rps"), num(l, "p50"),
+              num(l, "p90"), num(l, "p99"), num(l, "p99.9"),
+              num(j, "mean_batch_size"), num(j, "mean_padding"));
+      runs.push_back(j);
+    }
+  }
+  session.set_batch_policy(BatchPolicy());
+
+  nlohmann::json out;
+  out["context"] = {
+      {"model", CONFIG::asr_onnx},
+      {"session_loops", OnnxSession::kNumLoops},
+      {"utterances", utterances.size()},
+      {"rate", rate},
+      {"duration_s", duration},
+      {"warmup_s", warmup},
+      {"seed", seed},
+  };
+  out["runs"] = runs;
+  printf("%s\n", out.dump(2).c_str());
+  return 0;
+}
@@ -0,0 +1,386 @@
+// Microbenchmarks of the hot kernels, run on the bundled scripts/audios.
+// A table goes to stderr and one JSON document to stdout, so that two
+// builds can be compared:
+//
+//   ./bench [--audio-dir scripts/audios] [--min-time 0.5] [--filter str]
+//       > before.json
+//
+// allocs_per_op counts calls of operator new; onnxruntime allocates from
+// its own arena, which is not counted. The model benchmarks are skipped
+// when CONFIG::asr_onnx or CONFIG::vad_onnx cannot be found.
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "asr.h"
+#include "config.h"
+#include "fbank_computer.h"
+#include "lfr_cmvn.h"
+#include "onnx_engine.h"
+#include "resample.h"
+#include "sense_voice.h"
+#include "sense_voice_feature.h"
+#include "util.h"
+#include "vad.h"
+
+using sherpa_onnx::LinearResample;
+
+namespace {
+std::atomic<uint64_t> g_allocs{0};
+} // namespace
+
+void *operator new(size_t n) {
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(n ? n : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+template <typename T> inline void Keep(const T &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Result {
+  std::string name;
+  int64_t ops;
+  double ns_per_op;
+  double allocs_per_op;
+  double items_per_op;
+  std::string unit; // of items_per_op
+};
+
+class Bench {
+public:
+  Bench(double min_time, const std::string &filter)
+      : min_time_(min_time), filter_(filter) {
+    fprintf(stderr, "%-36s %14s %16s %10s\n", "benchmark", "ns/op",
+            "throughput", "allocs/op");
+  }
+
+  // f is one op, which processes items of unit
+  template <typename F>
+  void Run(const std::string &name, double items, const std::string &unit,
+           F &&f) {
+    if (!filter_.empty() && name.find(filter_) == std::string::npos) {
+      return;
+    }
+    f(); // warm up caches and lazily built tables
+    int64_t ops = 0;
+    uint64_t allocs = g_allocs.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{0};
+    do {
+      f();
+      ++ops;
+      elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < min_time_);
+    allocs = g_allocs.load(std::memory_order_relaxed) - allocs;
+
+    Result r{name,  ops, elapsed.count() * 1e9 / ops,
+             static_cast<double>(allocs) / ops, items, unit};
+    fprintf(stderr, "%-36s %14.0f %10.4g %s/s %10.1f\n", name.c_str(),
+            r.ns_per_op, items * 1e9 / r.ns_per_op, unit.c_str(),
+            r.allocs_per_op);
+    results_.push_back(r);
+  }
+
+  nlohmann::json Json() const {
+    nlohmann::json all = nlohmann::json::array();
+    for (auto &r : results_) {
+      nlohmann::json j;
+      j["name"] = r.name;
+      j["ops"] = r.ops;
+      j["ns_per_op"] = r.ns_per_op;
+      j["allocs_per_op"] = r.allocs_per_op;
+      j["items_per_op"] = r.items_per_op;
+      j["unit"] = r.unit;
+      j["throughput"] = r.items_per_op * 1e9 / r.ns_per_op; // unit per second
+      all.push_back(j);
+    }
+    return all;
+  }
+
+private:
+  const double min_time_;
+  const std::string filter_;
+  std::vector<Result> results_;
+};
+
+bool Exists(const std::string &path) { return std::ifstream(path).good(); }
+
+std::vector<std::string> ListWavs(const std::string &dir) {
+  std::vector<std::string> files;
+  if (DIR *d = opendir(dir.c_str())) {
+    while (dirent *e = readdir(d)) {
+      std::string name = e->d_name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) {
+        files.push_back(dir + "/" + name);
+      }
+    }
+    closedir(d);
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// SenseVoice's 7x80 LFR with CMVN of the given scale/bias
+std::vector<float> Features(const std::vector<float> &wave16k,
+                            const std::vector<float> &neg_mean,
+                            const std::vector<float> &inv_stddev) {
+  OnlineSenseVoiceFeature feature(7, 6, neg_mean, inv_stddev);
+  feature.AcceptWaveformAndFinish(wave16k.data(), wave16k.size());
+  return std::move(feature.Feats());
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string audio_dir = "scripts/audios";
+  double min_time = 0.5;
+  std::string filter;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--audio-dir" && i + 1 < argc) {
+      audio_dir = argv[++i];
+    } else if (arg == "--min-time" && i + 1 < argc) {
+      min_time = atof(argv[++i]);
+    } else if (arg == "--filter" && i + 1 < argc) {
+      filter = argv[++i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [--audio-dir dir] [--min-time seconds] "
+              "[--filter str]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  // The corpus: every file as read, the files of the first file's rate
+  // concatenated, and all of it at 16kHz in the int16 range
+  struct Wav {
+    int32_t sample_rate;
+    std::vector<float> samples; // [-1, 1]
+  };
+  std::vector<std::string> files = ListWavs(audio_dir);
+  std::vector<Wav> wavs;
+  for (auto &f : files) {
+    Wav w;
+    if (load_wav_file(f.c_str(), &w.sample_rate, w.samples)) {
+      wavs.push_back(std::move(w));
+    }
+  }
+  if (wavs.empty()) {
+    fprintf(stderr, "no wav files in %s\n", audio_dir.c_str());
+    return 1;
+  }
+  int32_t in_rate = wavs[0].sample_rate;
+  std::vector<float> corpus;
+  double seconds = 0;
+  for (auto &w : wavs) {
+    seconds += static_cast<double>(w.samples.size()) / w.sample_rate;
+    if (w.sample_rate == in_rate) {
+      corpus.insert(corpus.end(), w.samples.begin(), w.samples.end());
+    }
+  }
+  double corpus_seconds = static_cast<double>(corpus.size()) / in_rate;
+  std::vector<float> corpus16k;
+  if (in_rate == 16000) {
+    corpus16k = corpus;
+  } else {
+    LinearResample::Create(in_rate, 16000)
+        ->Resample(corpus.data(), corpus.size(), true, &corpus16k);
+  }
+  for (auto &x : corpus16k) {
+    x *= 32768;
+  }
+  double seconds16k = corpus16k.size() / 16000.0;
+
+  Bench bench(min_time, filter);
+
+  bench.Run("load_wav_file", seconds, "audio_s", [&] {
+    for (auto &f : files) {
+      int32_t rate = 0;
+      std::vector<float> data;
+      load_wav_file(f.c_str(), &rate, data);
+      Keep(data);
+    }
+  });
+
+  std::string rates = std::to_string(in_rate) + "->16000";
+  bench.Run("resample/libsamplerate/" + rates, corpus_seconds, "audio_s",
+            [&] { Keep(resample(corpus, in_rate)); });
+  {
+    auto resampler = LinearResample::Create(in_rate, 16000);
+    std::vector<float> out;
+    bench.Run("LinearResample::Resample/" + rates, corpus_seconds, "audio_s",
+              [&] {
+                resampler->Resample(corpus.data(), corpus.size(), true, &out);
+                Keep(out);
+              });
+  }
+
+  std::vector<float> fbank;
+  bench.Run("FbankComputer::Compute", seconds16k, "audio_s", [&] {
+    fbank = FbankComputer::get().Compute(corpus16k.data(), corpus16k.size());
+  });
+
+  {
+    // the CMVN values do not matter for the speed
+    const int32_t dim = FbankComputer::kNumBins, window = 7, shift = 6;
+    std::vector<float> scale(window * dim, 1.0f), bias(window * dim, 0.0f);
+    int32_t num_fbank = fbank.size() / dim;
+    int32_t num_lfr = (num_fbank + shift - 1) / shift;
+    std::vector<float> out(static_cast<size_t>(num_lfr) * window * dim);
+    bench.Run("LfrCmvn/7x80", num_lfr, "frames", [&] {
+      const float *rows[7];
+      for (int32_t i = 0; i < num_lfr; ++i) {
+        for (int32_t w = 0; w < window; ++w) {
+          rows[w] = fbank.data() +
+                    std::min(i * shift + w, num_fbank - 1) * dim;
+        }
+        LfrCmvn(rows, window, dim, scale.data(), bias.data(),
+                out.data() + static_cast<size_t>(i) * window * dim);
+      }
+      Keep(out);
+    });
+
+    std::vector<float> neg_mean(window * dim, 0.0f);
+    std::vector<float> inv_stddev(window * dim, 1.0f);
+    bench.Run("OnlineSenseVoiceFeature", seconds16k, "audio_s", [&] {
+      Keep(Features(corpus16k, neg_mean, inv_stddev));
+    });
+
+    // one batch of CONFIG::max_batch files, as the OnnxSession pads it
+    std::vector<std::shared_ptr<Request>> reqs;
+    std::vector<Ort::Value> values;
+    auto memory_info =
+        Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+    int64_t frames = 0;
+    for (size_t i = 0; i < wavs.size() && reqs.size() < CONFIG::max_batch;
+         ++i) {
+      std::vector<float> wave16k;
+      LinearResample::Create(wavs[i].sample_rate, 16000)
+          ->Resample(wavs[i].samples.data(), wavs[i].samples.size(), true,
+                     &wave16k);
+      for (auto &x : wave16k) {
+        x *= 32768;
+      }
+      auto req = std::make_shared<Request>();
+      ArrayWithShape x;
+      x.data_float = Features(wave16k, neg_mean, inv_stddev);
+      x.shape = {static_cast<int64_t>(x.data_float.size() / (window * dim)),
+                 window * dim};
+      frames += x.shape[0];
+      req->_input_arrays.push_back(std::move(x));
+      reqs.push_back(req);
+    }
+    for (auto &req : reqs) {
+      auto &x = req->_input_arrays[0];
+      values.push_back(Ort::Value::CreateTensor(
+          memory_info, x.data_float.data(), x.data_float.size(),
+          x.shape.data(), x.shape.size()));
+    }
+    Ort::AllocatorWithDefaultOptions allocator;
+    std::string batch = "/batch" + std::to_string(reqs.size());
+    bench.Run("PadSequence<float>" + batch, frames, "frames", [&] {
+      Keep(PadSequence<float>(allocator, values, 0));
+    });
+    bench.Run("make_tensor" + batch, frames, "frames",
+              [&] { Keep(make_tensor(reqs, 0)); });
+  }
+
+  if (Exists(CONFIG::vad_onnx)) {
+    silero_vad::SileroVAD vad(CONFIG::vad_onnx);
+    const size_t window = 512; // 32ms at 16kHz
+    size_t num_windows = corpus16k.size() / window;
+    std::vector<std::vector<float>> windows(num_windows);
+    for (size_t i = 0; i < num_windows; ++i) {
+      windows[i].resize(window);
+      for (size_t k = 0; k < window; ++k) {
+        windows[i][k] = corpus16k[i * window + k] / 32768;
+      }
+    }
+    size_t next = 0;
+    bench.Run("SileroVAD::predict", window / 16000.0, "audio_s", [&] {
+      Keep(vad.predict(windows[next]));
+      next = (next + 1) % num_windows;
+    });
+  } else {
+    fprintf(stderr, "skipping the vad, %s not found\n",
+            CONFIG::vad_onnx.c_str());
+  }
+
+  // greedy ctc decoding as BatchSenseVoice::decode() does it, on random
+  // logits of the size SenseVoice outputs for 10s
+  {
+    const int32_t vocab = 25055;
+    const int32_t rows = 10 * 100 / 6 + SenseVoice::kNumPromptFrames;
+    std::vector<float> logits(static_cast<size_t>(rows) * vocab);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-10, 10);
+    for (auto &x : logits) {
+      x = dist(rng);
+    }
+    bench.Run("argmax+unique_consecutive/10s", rows, "frames", [&] {
+      std::vector<int64_t> ids(rows);
+      for (int32_t i = 0; i < rows; ++i) {
+        const float *row = logits.data() + static_cast<size_t>(i) * vocab;
+        ids[i] = std::max_element(row, row + vocab) - row;
+      }
+      Keep(unique_consecutive<int64_t>(ids));
+    });
+  }
+
+  if (Exists(CONFIG::asr_onnx) && Exists(CONFIG::tokens)) {
+    SenseVoice model(CONFIG::asr_onnx, CONFIG::tokens);
+    for (int32_t length : {2, 5, 10}) {
+      std::vector<float> wave;
+      while (wave.size() < static_cast<size_t>(length) * 16000) {
+        wave.insert(wave.end(), corpus16k.begin(), corpus16k.end());
+      }
+      wave.resize(static_cast<size_t>(length) * 16000);
+      auto feature = model.create_feature();
+      feature->AcceptWaveformAndFinish(wave.data(), wave.size());
+      std::vector<float> feats = feature->Feats();
+      bench.Run("SenseVoice::infer/" + std::to_string(length) + "s", length,
+                "audio_s", [&] { Keep(model.infer(feats)); });
+    }
+  } else {
+    fprintf(stderr, "skipping SenseVoice, %s not found\n",
+            CONFIG::asr_onnx.c_str());
+  }
+
+  nlohmann::json out;
+  out["context"] = {
+      {"compiler", __VERSION__},
+#ifdef NDEBUG
+      {"build", "release"},
+#else
+      {"build", "debug"},
+#endif
+      {"resample_isa", LinearResample::Isa()},
+      {"lfr_cmvn_isa", LfrCmvnIsa()},
+      {"audio_dir", audio_dir},
+      {"audio_files", wavs.size()},
+      {"audio_seconds", seconds},
+      {"min_time", min_time},
+  };
+  out["benchmarks"] = bench.Json();
+  printf("%s\n", out.dump(2).c_str());
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Checks FbankComputer against kaldi-native-fbank, which it replaced in
+// every front end. Both run on each file of scripts/audios (resampled to
+// 16kHz, int16 range) with the options SenseVoice::recog used to give
+// knf::OnlineFbank; it fails unless every frame count matches and the
+// largest absolute difference in log mel is within the tolerance:
+//
+//   ./fbank_parity [--audio-dir scripts/audios] [--tolerance 1e-2]
+//
+// Both compute in float and floor the mel energies at FLT_EPSILON before
+// the log, so what differs is rounding in the FFT and the mel sums.
+#include <dirent.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "fbank_computer.h"
+#include "kaldi-native-fbank/csrc/feature-fbank.h"
+#include "kaldi-native-fbank/csrc/online-feature.h"
+#include "resample.h"
+#include "util.h"
+
+namespace {
+
+std::vector<std::string> ListWavs(const std::string &dir) {
+  std::vector<std::string> files;
+  if (DIR *d = opendir(dir.c_str())) {
+    while (dirent *e = readdir(d)) {
+      std::string name = e->d_name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) {
+        files.push_back(dir + "/" + name);
+      }
+    }
+    closedir(d);
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// as sense_voice_feature.cpp set them up before FbankComputer
+knf::FbankOptions SenseVoiceFbankOptions() {
+  knf::FbankOptions opts;
+  opts.frame_opts.dither = 0;
+  opts.frame_opts.snip_edges = false;
+  opts.frame_opts.window_type = "hamming";
+  opts.frame_opts.samp_freq = 16000;
+  opts.mel_opts.num_bins = 80;
+  return opts;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string audio_dir = "scripts/audios";
+  double tolerance = 1e-2;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--audio-dir" && i + 1 < argc) {
+      audio_dir = argv[++i];
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--audio-dir dir] [--tolerance max_abs]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<std::string> files = ListWavs(audio_dir);
+  if (files.empty()) {
+    fprintf(stderr, "no wav files in %s\n", audio_dir.c_str());
+    return 1;
+  }
+  const int32_t dim = FbankComputer::kNumBins;
+  int32_t failed = 0;
+  double worst = 0, sum = 0;
+  int64_t count = 0;
+  for (auto &f : files) {
+    int32_t sample_rate = 0;
+    std::vector<float> samples;
+    if (!load_wav_file(f.c_str(), &sample_rate, samples)) {
+      fprintf(stderr, "failed to read %s\n", f.c_str());
+      ++failed;
+      continue;
+    }
+    if (sample_rate != 16000) {
+      std::vector<float> wave16k;
+      sherpa_onnx::LinearResample::Create(sample_rate, 16000)
+          ->Resample(samples.data(), samples.size(), true, &wave16k);
+      samples.swap(wave16k);
+    }
+    for (auto &x : samples) {
+      x *= 32768;
+    }
+
+    knf::OnlineFbank knf_fbank(SenseVoiceFbankOptions());
+    knf_fbank.AcceptWaveform(16000, samples.data(), samples.size());
+    knf_fbank.InputFinished();
+    std::vector<float> ours =
+        FbankComputer::get().Compute(samples.data(), samples.size());
+    int32_t num_frames = static_cast<int32_t>(ours.size() / dim);
+    if (knf_fbank.NumFramesReady() != num_frames) {
+      fprintf(stderr, "%s: %d frames, knf has %d\n", f.c_str(), num_frames,
+              knf_fbank.NumFramesReady());
+      ++failed;
+      continue;
+    }
+
+    double max_diff = 0;
+    for (int32_t i = 0; i < num_frames; ++i) {
+      const float *ref = knf_fbank.GetFrame(i);
+      for (int32_t k = 0; k < dim; ++k) {
+        double d = std::fabs(ours[static_cast<size_t>(i) * dim + k] - ref[k]);
+        max_diff = std::max(max_diff, d);
+        sum += d;
+      }
+    }
+    count += static_cast<int64_t>(num_frames) * dim;
+    worst = std::max(worst, max_diff);
+    if (max_diff > tolerance) {
+      fprintf(stderr, "%s: max abs diff %.3g over %.3g\n", f.c_str(),
+              max_diff, tolerance);
+      ++failed;
+    }
+  }
+
+  printf("%zu files, max abs diff %.3g, mean abs diff %.3g, tolerance %.3g: "
+         "%s\n",
+         files.size(), worst, count ? sum / count : 0.0, tolerance,
+         failed ? "FAILED" : "ok");
+  return failed ? 1 : 0;
+}
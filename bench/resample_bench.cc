@@ -0,0 +1,115 @@
+// Throughput of LinearResample::Resample against the row-per-phase scalar
+// loop it replaced, for the rate pairs the server sees.
+//
+//   ./resample_bench [seconds_of_audio]
+#include "resample.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using sherpa_onnx::LinearResample;
+using sherpa_onnx::LinearResampleFilter;
+
+namespace {
+
+// The previous implementation: one std::vector<float> per phase and a
+// scalar dot product, whole signal in one flush call.
+struct ReferenceResampler {
+  explicit ReferenceResampler(const LinearResampleFilter &f) : f(f) {
+    rows.resize(f.output_samples_in_unit);
+    for (int32_t i = 0; i < f.output_samples_in_unit; ++i) {
+      rows[i].assign(f.Weights(i), f.Weights(i) + f.num_taps[i]);
+    }
+  }
+
+  void Resample(const std::vector<float> &in, std::vector<float> *out) const {
+    int64_t n = static_cast<int64_t>(in.size()) * f.samp_rate_out /
+                f.samp_rate_in;
+    out->resize(n);
+    for (int64_t s = 0; s < n; ++s) {
+      int64_t unit = s / f.output_samples_in_unit;
+      auto phase = static_cast<int32_t>(s - unit * f.output_samples_in_unit);
+      int64_t first = f.first_index[phase] + unit * f.input_samples_in_unit;
+      const std::vector<float> &w = rows[phase];
+      float sum = 0;
+      if (first >= 0 && first + static_cast<int64_t>(w.size()) <=
+                            static_cast<int64_t>(in.size())) {
+        for (size_t i = 0; i < w.size(); ++i) {
+          sum += in[first + i] * w[i];
+        }
+      } else {
+        for (size_t i = 0; i < w.size(); ++i) {
+          int64_t k = first + i;
+          if (k >= 0 && k < static_cast<int64_t>(in.size())) {
+            sum += w[i] * in[k];
+          }
+        }
+      }
+      (*out)[s] = sum;
+    }
+  }
+
+  const LinearResampleFilter &f;
+  std::vector<std::vector<float>> rows;
+};
+
+template <typename F> double SecondsPerRun(F &&f) {
+  f(); // warm up
+  int32_t runs = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed{0};
+  do {
+    f();
+    ++runs;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed.count() < 0.5);
+  return elapsed.count() / runs;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  float seconds = argc > 1 ? atof(argv[1]) : 10.0f;
+  const int32_t out_rate = 16000;
+  const int32_t in_rates[] = {8000, 22050, 44100, 48000};
+
+  printf("kernel: %s\n", LinearResample::Isa());
+  printf("%-14s %6s %14s %14s %8s %10s\n", "rates", "taps", "ref samp/s",
+         "simd samp/s", "speedup", "max diff");
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> dist(-32768, 32767);
+  for (int32_t in_rate : in_rates) {
+    std::vector<float> in(static_cast<size_t>(seconds * in_rate));
+    for (auto &x : in) {
+      x = dist(rng);
+    }
+
+    auto resampler = LinearResample::Create(in_rate, out_rate);
+    const LinearResampleFilter &f = *LinearResampleFilter::Get(
+        in_rate, out_rate, 0.99f * 0.5f * std::min(in_rate, out_rate), 6);
+    ReferenceResampler ref(f);
+
+    std::vector<float> out, ref_out;
+    double t_ref = SecondsPerRun([&] { ref.Resample(in, &ref_out); });
+    double t_new = SecondsPerRun(
+        [&] { resampler->Resample(in.data(), in.size(), true, &out); });
+
+    float max_diff = 0;
+    size_t n = std::min(out.size(), ref_out.size());
+    for (size_t i = 0; i < n; ++i) {
+      max_diff = std::max(max_diff, std::fabs(out[i] - ref_out[i]));
+    }
+
+    char rates[32];
+    snprintf(rates, sizeof(rates), "%d->%d", in_rate, out_rate);
+    printf("%-14s %6d %14.3e %14.3e %7.2fx %10.3g\n", rates, f.stride,
+           in.size() / t_ref, in.size() / t_new, t_ref / t_new, max_diff);
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// A fixed capacity multi-producer / multi-consumer queue used to hand work
+// from one pipeline stage to the next. Producers that must not block (e.g.
+// the VAD thread) use try_push() and decide themselves what to do when the
+// downstream stage can not keep up.
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : _capacity(capacity) {}
+
+  // Block until there is room for one more item. Returns false if the queue
+  // has been closed.
+  bool push(T item) {
+    std::unique_lock<std::mutex> lk(_mx);
+    _not_full.wait(lk, [this] { return _closed || _items.size() < _capacity; });
+    if (_closed) {
+      return false;
+    }
+    _items.push_back(std::move(item));
+    _not_empty.notify_one();
+    return true;
+  }
+
+  // Never blocks. Returns false if the queue is full or closed.
+  bool try_push(T &item) {
+    std::lock_guard<std::mutex> lk(_mx);
+    if (_closed || _items.size() >= _capacity) {
+      return false;
+    }
+    _items.push_back(std::move(item));
+    _not_empty.notify_one();
+    return true;
+  }
+
+  // Block until an item is available. Returns false once the queue is closed
+  // and drained.
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> lk(_mx);
+    _not_empty.wait(lk, [this] { return _closed || !_items.empty(); });
+    if (_items.empty()) {
+      return false;
+    }
+    item = std::move(_items.front());
+    _items.pop_front();
+    _not_full.notify_one();
+    return true;
+  }
+
+  bool try_pop(T &item) {
+    std::lock_guard<std::mutex> lk(_mx);
+    if (_items.empty()) {
+      return false;
+    }
+    item = std::move(_items.front());
+    _items.pop_front();
+    _not_full.notify_one();
+    return true;
+  }
+
+  // Wake up every waiter. Items already queued can still be popped.
+  void close() {
+    std::lock_guard<std::mutex> lk(_mx);
+    _closed = true;
+    _not_empty.notify_all();
+    _not_full.notify_all();
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lk(_mx);
+    return _items.size();
+  }
+
+  size_t capacity() const { return _capacity; }
+
+private:
+  const size_t _capacity;
+  bool _closed = false;
+  std::deque<T> _items;
+  std::mutex _mx;
+  std::condition_variable _not_empty;
+  std::condition_variable _not_full;
+};
@@ -4,15 +4,17 @@
     > Mail: 1216451203@qq.com
     > Created Time: 2025年03月11日 星期二 23时23分33秒
  ************************************************************************/
-/*
-#include <chrono>
-#include <iomanip>
-*/
 #include <clog.h>
-#include <iostream>
+#include <pthread.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <mutex>
 #include <thread>
-#include <util.h>
+#include <vector>
 
 #define RESET "\033[0m"
 #define BLACK "\033[30m"              /* Black */
@@ -32,50 +34,234 @@
 #define BOLDCYAN "\033[1m\033[36m"    /* Bold Cyan */
 #define BOLDWHITE "\033[1m\033[37m"   /* Bold White */
 
-CLogger::CLogger(PLogLevel level, const char *file, int line) {
-  line_ = line;
-  std::string filePath(file);
-  file_ = filePath.substr(filePath.find_last_of("/\\") + 1);
-  level_ = level;
-
-  std::string color = "";
-
-  switch (level_) {
-  case PLogLevel::INFO:
-    level_str_ = "INFO";
-    color = GREEN;
-    break;
-  case PLogLevel::DEBUG:
-    level_str_ = "DEBUG";
-    color = MAGENTA;
-    break;
-  case PLogLevel::WARNING:
-    level_str_ = "WARNING";
-    color = RED;
-    break;
-  case PLogLevel::ERROR:
-    level_str_ = "ERROR";
-    color = RED;
-    break;
+namespace {
+
+// indexed by PLogLevel
+const char *const kPrefix[] = {MAGENTA "DEBUG ", GREEN "INFO ",
+                               RED "WARNING ", RED "ERROR "};
+
+int LevelFromEnv() {
+  const char *env = std::getenv("CLOG_LEVEL");
+  if (!env) {
+    return static_cast<int>(PLogLevel::INFO);
   }
-  /*
+  const char *names[] = {"debug", "info", "warning", "error"};
+  for (int i = 0; i < 4; ++i) {
+    if (strcasecmp(env, names[i]) == 0) {
+      return i;
+    }
+  }
+  return static_cast<int>(PLogLevel::INFO);
+}
+
+// "2025-03-11 23:16:31.123", localtime is only called once per second
+void AppendTime(std::string &out) {
+  thread_local time_t cached_sec = -1;
+  thread_local char cached[24];
   auto now = std::chrono::system_clock::now();
   auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now.time_since_epoch()) %
-            1000;
-  auto timer = std::chrono::system_clock::to_time_t(now);
-  std::tm bt = *std::localtime(&timer);
-  */
-
-  log_stream_ << color.c_str() << level_str_ << " " 
-              << getCurrentTime() << " "  
-              << std::this_thread::get_id() << " "
-              << file_ << ":" << line_ << "\t" ;
+                now.time_since_epoch())
+                .count();
+  time_t sec = static_cast<time_t>(ms / 1000);
+  if (sec != cached_sec) {
+    std::tm tm;
+    localtime_r(&sec, &tm);
+    std::strftime(cached, sizeof(cached), "%Y-%m-%d %H:%M:%S", &tm);
+    cached_sec = sec;
+  }
+  char millis[5] = {'.', static_cast<char>('0' + ms % 1000 / 100),
+                    static_cast<char>('0' + ms % 100 / 10),
+                    static_cast<char>('0' + ms % 10), '\0'};
+  out += cached;
+  out += millis;
+}
+
+const std::string &ThreadId() {
+  thread_local std::string id = [] {
+    std::ostringstream os;
+    os << std::this_thread::get_id();
+    return os.str();
+  }();
+  return id;
+}
+
+// Lines of one thread on their way to stdout. Single producer (the thread)
+// and single consumer (whoever holds AsyncWriter::write_mx_); the strings
+// are swapped in and out, so their memory is reused.
+struct LineQueue {
+  static constexpr uint64_t kSize = 1024;
+  std::string slots[kSize];
+  std::atomic<uint64_t> head{0}; // lines pushed
+  std::atomic<uint64_t> tail{0}; // lines written
+};
+
+class AsyncWriter {
+public:
+  // Never destroyed: threads may still log while statics are torn down
+  static AsyncWriter &get() {
+    static AsyncWriter *inst = new AsyncWriter;
+    return *inst;
+  }
+
+  // Takes line, leaving an empty string with spare capacity in its place
+  void Push(std::string &line, bool sync) {
+    LineQueue &q = local();
+    uint64_t head = q.head.load(std::memory_order_relaxed);
+    while (head - q.tail.load(std::memory_order_acquire) >= LineQueue::kSize) {
+      Drain(); // full, write it out on this thread
+    }
+    q.slots[head % LineQueue::kSize].swap(line);
+    q.head.store(head + 1, std::memory_order_release);
+    if (sync) {
+      Drain();
+    }
+  }
+
+  void Drain() {
+    std::lock_guard<std::mutex> lock(write_mx_);
+    DrainLocked();
+  }
+
+private:
+  AsyncWriter() {
+    thread_ = new std::thread(&AsyncWriter::Loop, this);
+    std::atexit([] { AsyncWriter::get().Drain(); });
+    // A forked child has no writer thread; lines pending at the fork are
+    // written before it, so that they do not come out twice.
+    pthread_atfork(
+        [] {
+          auto &w = AsyncWriter::get();
+          w.write_mx_.lock();
+          w.DrainLocked();
+          w.mx_.lock();
+        },
+        [] {
+          auto &w = AsyncWriter::get();
+          w.mx_.unlock();
+          w.write_mx_.unlock();
+        },
+        [] {
+          auto &w = AsyncWriter::get();
+          w.mx_.unlock();
+          w.write_mx_.unlock();
+          // the old one belongs to a thread that does not exist here
+          w.thread_ = new std::thread(&AsyncWriter::Loop, &w);
+        });
+  }
+
+  LineQueue &local() {
+    thread_local LineQueue *q = nullptr;
+    if (!q) {
+      auto owned = std::make_unique<LineQueue>();
+      q = owned.get();
+      std::lock_guard<std::mutex> lock(mx_);
+      queues_.push_back(std::move(owned));
+    }
+    return *q;
+  }
+
+  // Polls rather than being woken, so that logging never makes a syscall
+  void Loop() {
+    for (;;) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      Drain();
+    }
+  }
+
+  void DrainLocked() {
+    std::vector<LineQueue *> queues;
+    {
+      std::lock_guard<std::mutex> lock(mx_);
+      for (auto &q : queues_) {
+        queues.push_back(q.get());
+      }
+    }
+    bool wrote = false;
+    for (auto *q : queues) {
+      uint64_t tail = q->tail.load(std::memory_order_relaxed);
+      uint64_t head = q->head.load(std::memory_order_acquire);
+      for (; tail != head; ++tail) {
+        std::string &line = q->slots[tail % LineQueue::kSize];
+        std::fwrite(line.data(), 1, line.size(), stdout);
+        line.clear();
+      }
+      if (tail != q->tail.load(std::memory_order_relaxed)) {
+        q->tail.store(tail, std::memory_order_release);
+        wrote = true;
+      }
+    }
+    if (wrote) {
+      std::fflush(stdout);
+    }
+  }
+
+  std::thread *thread_; // leaked, the writer runs until the process exits
+  std::mutex write_mx_; // held by the consumer of all queues
+  std::mutex mx_;       // guards queues_, taken after write_mx_
+  std::vector<std::unique_ptr<LineQueue>> queues_; // outlive their threads
+};
+
+} // namespace
+
+// The line being formatted, with an ostream that appends to it
+struct CLogger::Buffer : public std::streambuf {
+  Buffer() : os(this) {}
+
+  int_type overflow(int_type c) override {
+    if (c != traits_type::eof()) {
+      line.push_back(static_cast<char>(c));
+    }
+    return c;
+  }
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    line.append(s, n);
+    return n;
+  }
+
+  std::string line;
+  std::ostream os;
+  bool in_use = false;
+};
+
+std::atomic<int> CLogger::threshold_{LevelFromEnv()};
+
+CLogger::CLogger(PLogLevel level, const char *file, int line)
+    : level_(level) {
+  thread_local Buffer buffer;
+  // something streamed into this line may log itself
+  owned_ = buffer.in_use;
+  buf_ = owned_ ? new Buffer : &buffer;
+  buf_->in_use = true;
+  os_ = &buf_->os;
+  // the stream is reused, so undo std::fixed and the like of the last line
+  os_->flags(std::ios_base::dec | std::ios_base::skipws);
+  os_->precision(6);
+  os_->width(0);
+  os_->fill(' ');
+
+  const char *name = std::strrchr(file, '/');
+  std::string &out = buf_->line;
+  out.clear();
+  out += kPrefix[static_cast<int>(level)];
+  AppendTime(out);
+  out += ' ';
+  out += ThreadId();
+  out += ' ';
+  out += name ? name + 1 : file;
+  out += ':';
+  out += std::to_string(line);
+  out += '\t';
 }
 
-CLogger::~CLogger() {}
+CLogger::~CLogger() {
+  if (owned_) {
+    delete buf_;
+  } else {
+    buf_->in_use = false;
+  }
+}
 
-std::string CLogger::toString() const { return log_stream_.str(); }
+std::string CLogger::toString() const { return buf_->line; }
 
 CLogger &CLogger::ref() { return *this; }
 
@@ -83,8 +269,10 @@ PLogLevel CLogger::lever() const { return level_; }
 
 LogDump::LogDump() {}
 
-void LogDump::operator+=(const CLogger &logger) {
-  static std::mutex mutex;
-  std::lock_guard<std::mutex> lock(mutex);
-  std::cout << logger.toString() << "\033[0m" << std::endl;
+void LogDump::operator+=(CLogger &logger) {
+  logger.buf_->line += RESET "\n";
+  AsyncWriter::get().Push(logger.buf_->line,
+                          logger.level_ == PLogLevel::ERROR);
 }
+
+void FlushLogs() { AsyncWriter::get().Drain(); }
@@ -5,38 +5,78 @@
     > Created Time: 2025年03月11日 星期二 23时16分31秒
  ************************************************************************/
 #pragma once
+#include <atomic>
 #include <ctime>
 #include <sstream>
+#include <string>
 
-enum class PLogLevel { INFO, DEBUG, WARNING, ERROR };
+// Ordered by severity
+enum class PLogLevel { DEBUG, INFO, WARNING, ERROR };
 
+// Levels below CLOG_MIN_LEVEL (0 DEBUG .. 3 ERROR) are compiled out, e.g.
+// -DCLOG_MIN_LEVEL=1 for a build without debug logs. The rest is checked
+// against the runtime threshold, from the CLOG_LEVEL environment variable
+// (debug, info, warning or error; info if unset), before anything is
+// formatted.
+#ifndef CLOG_MIN_LEVEL
+#define CLOG_MIN_LEVEL 0
+#endif
+
+// Formats one line into a buffer of the calling thread. LogDump hands the
+// line to the thread's queue, which a background thread writes to stdout;
+// logging never waits for the terminal, except for ERROR lines, which are
+// written before PLOGE returns so that they survive a crash.
 class CLogger {
 public:
   CLogger(PLogLevel lever, const char *file, int line);
   ~CLogger();
   std::string toString() const;
   template <typename T> CLogger &operator<<(const T &value) {
-    log_stream_ << value;
+    *os_ << value;
     return *this;
   }
   CLogger &ref();
 
   PLogLevel lever() const;
 
+  static bool Enabled(PLogLevel level) {
+    int l = static_cast<int>(level);
+    return l >= CLOG_MIN_LEVEL &&
+           l >= threshold_.load(std::memory_order_relaxed);
+  }
+  static void SetLevel(PLogLevel level) {
+    threshold_.store(static_cast<int>(level), std::memory_order_relaxed);
+  }
+
 private:
-  int line_;
+  friend class LogDump;
+  struct Buffer;
+
   PLogLevel level_;
-  std::string file_;
-  std::string level_str_;
-  std::stringstream log_stream_;
+  Buffer *buf_;  // the thread's, or owned if it was in use already
+  bool owned_;
+  std::ostream *os_;
+
+  static std::atomic<int> threshold_;
 };
 
 class LogDump {
 public:
   LogDump();
-  void operator+=(const CLogger &logger);
+  void operator+=(CLogger &logger);
 };
 
-#define PLOGI LogDump() += CLogger(PLogLevel::INFO, __FILE__, __LINE__).ref()
-#define PLOGD LogDump() += CLogger(PLogLevel::DEBUG, __FILE__, __LINE__).ref()
-#define PLOGE LogDump() += CLogger(PLogLevel::ERROR, __FILE__, __LINE__).ref()
+// Writes out every line logged so far; for processes that leave with
+// _exit()
+void FlushLogs();
+
+#define PLOG_IF(level)                                                         \
+  if (!CLogger::Enabled(level))                                                \
+    ;                                                                          \
+  else                                                                         \
+    LogDump() += CLogger(level, __FILE__, __LINE__).ref()
+
+#define PLOGD PLOG_IF(PLogLevel::DEBUG)
+#define PLOGI PLOG_IF(PLogLevel::INFO)
+#define PLOGW PLOG_IF(PLogLevel::WARNING)
+#define PLOGE PLOG_IF(PLogLevel::ERROR)
@@ -16,9 +16,44 @@ const std::string tokens =
 const std::string vad_onnx = "silero_vad.onnx";
 const int max_batch = 5;
 const int max_utterance_length = 10; // 10s
+// longer uploads are cut by the vad on the server, up to this length
+const int max_upload_length = 3600; // 1h
+
+// asr pipeline
+const int asr_queue_size = 8;    // finished segments waiting for recognition
+const int asr_recog_threads = 1; // >1 may deliver results out of order
 
 // ws
 const u_int16_t ws_port = 6001;
+const int32_t asr_sample_rate = 16000; // other rates are resampled to this
 const int32_t num_io_threads = 4;
-const int32_t num_work_threads = 4;
+const int32_t max_streams_per_connection = 64; // multiplexed uploads
+// >0: prefork this many server processes sharing ws_port (SO_REUSEPORT),
+// spread over the numa nodes and restarted when they die
+const int32_t num_workers = 0;
+// unix socket of the shared memory transport for clients on this host,
+// empty to disable; prefork workers append ".<index>". Only the server's
+// user may connect (mode 0600); put it in a private directory such as
+// $XDG_RUNTIME_DIR, e.g. "/run/user/1000/sense_voice_asr.sock", not /tmp.
+const std::string local_socket = "";
+
+// ws pipeline: receive (io threads) -> features -> inference -> decode
+const int32_t num_feature_threads = 2;
+const int32_t num_decode_threads = 2;
+const int32_t stage_queue_size = 64;       // per stage, blocks when full
+const int32_t max_inflight_requests = 32;  // submitted to the OnnxSession
+const int32_t metrics_interval = 10;       // seconds between pipeline logs
+// an upload is fed to the features stage every this many new samples
+const int32_t feature_chunk_samples = 3200;
+// cut silent lead-in and tail of short uploads before inference
+const bool trim_silence = true;
+const float trim_pad_ms = 200;   // kept around the speech
+const float trim_range_db = 35;  // speech is within this of the loudest 10ms
+const float trim_floor_db = 30;  // and above this (int16 range mean square)
+// LRU cache of transcripts keyed by a hash of the audio, for clients that
+// send the same recordings repeatedly; 0 disables. Clients then share
+// transcripts of identical audio, so enable it only among trusted ones.
+const int32_t transcript_cache_mb = 0;
+// spans kept per thread for GET /trace and ?timings=1 replies; 0 disables
+const int32_t trace_spans_per_thread = 8192;
 } // namespace CONFIG
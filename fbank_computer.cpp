@@ -0,0 +1,299 @@
+#include "fbank_computer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FBANK_X86 1
+#endif
+
+namespace {
+
+constexpr int32_t kL = FbankComputer::kLanes;
+constexpr int32_t kHalf = FbankComputer::kFftSize / 2; // complex fft size
+// the mel banks use bins [0, kFftSize / 2), the nyquist bin is unused
+constexpr int32_t kNumFftBins = FbankComputer::kFftSize / 2;
+constexpr int32_t kNumBins = FbankComputer::kNumBins;
+constexpr int32_t kFrameLength = FbankComputer::kFrameLength;
+
+inline float MelScale(float freq) {
+  return 1127.0f * logf(1.0f + freq / 700.0f);
+}
+
+struct Tables {
+  float window[kFrameLength];
+  int32_t bitrev[kHalf];
+  // e^{-2 pi i k / kHalf}, k < kHalf / 2
+  float tw_re[kHalf / 2];
+  float tw_im[kHalf / 2];
+  // e^{-2 pi i k / kFftSize}, k < kHalf, splits the half size complex fft
+  // into the real fft
+  float post_re[kHalf];
+  float post_im[kHalf];
+
+  struct Band {
+    int32_t first = 0;
+    std::vector<float> weights;
+  };
+  Band bands[kNumBins];
+
+  Tables() {
+    double a = 2 * M_PI / (kFrameLength - 1);
+    for (int32_t i = 0; i < kFrameLength; ++i) {
+      window[i] = 0.54 - 0.46 * cos(a * i);
+    }
+
+    int32_t bits = 0;
+    while ((1 << bits) < kHalf) {
+      ++bits;
+    }
+    for (int32_t i = 0; i < kHalf; ++i) {
+      int32_t r = 0;
+      for (int32_t b = 0; b < bits; ++b) {
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      }
+      bitrev[i] = r;
+    }
+    for (int32_t k = 0; k < kHalf / 2; ++k) {
+      tw_re[k] = cos(2 * M_PI * k / kHalf);
+      tw_im[k] = -sin(2 * M_PI * k / kHalf);
+    }
+    for (int32_t k = 0; k < kHalf; ++k) {
+      post_re[k] = cos(2 * M_PI * k / FbankComputer::kFftSize);
+      post_im[k] = -sin(2 * M_PI * k / FbankComputer::kFftSize);
+    }
+
+    // same as knf::MelBanks with low_freq = 20, high_freq = nyquist
+    float fft_bin_width = 16000.0f / FbankComputer::kFftSize;
+    float mel_low = MelScale(20);
+    float mel_high = MelScale(8000);
+    float mel_delta = (mel_high - mel_low) / (kNumBins + 1);
+    for (int32_t bin = 0; bin < kNumBins; ++bin) {
+      float left = mel_low + bin * mel_delta;
+      float center = mel_low + (bin + 1) * mel_delta;
+      float right = mel_low + (bin + 2) * mel_delta;
+      int32_t first = -1, last = -1;
+      std::vector<float> w(kNumFftBins, 0);
+      for (int32_t i = 0; i < kNumFftBins; ++i) {
+        float mel = MelScale(fft_bin_width * i);
+        if (mel > left && mel < right) {
+          w[i] = mel <= center ? (mel - left) / (center - left)
+                               : (right - mel) / (right - center);
+          if (first == -1) {
+            first = i;
+          }
+          last = i;
+        }
+      }
+      if (first == -1) {
+        first = last = 0;
+      }
+      bands[bin].first = first;
+      bands[bin].weights.assign(w.begin() + first, w.begin() + last + 1);
+    }
+  }
+};
+
+const Tables &GetTables() {
+  static const Tables tables;
+  return tables;
+}
+
+// Everything after framing, for one block of kL frames stored lane
+// interleaved: bit reversed complex input in re/im, log mel out in mel.
+// Every inner loop runs over the lanes, so it vectorises without
+// reassociating any sum.
+__attribute__((always_inline)) inline void
+ProcessBlockImpl(const Tables &t, float *re, float *im, float *power,
+                 float *mel) {
+  // radix-2 decimation in time, half size complex fft
+  for (int32_t size = 2; size <= kHalf; size *= 2) {
+    int32_t half = size / 2;
+    int32_t step = kHalf / size;
+    for (int32_t start = 0; start < kHalf; start += size) {
+      for (int32_t j = 0; j < half; ++j) {
+        float wr = t.tw_re[j * step];
+        float wi = t.tw_im[j * step];
+        float *ar = re + (start + j) * kL;
+        float *ai = im + (start + j) * kL;
+        float *br = re + (start + j + half) * kL;
+        float *bi = im + (start + j + half) * kL;
+        for (int32_t l = 0; l < kL; ++l) {
+          float tr = wr * br[l] - wi * bi[l];
+          float ti = wr * bi[l] + wi * br[l];
+          br[l] = ar[l] - tr;
+          bi[l] = ai[l] - ti;
+          ar[l] += tr;
+          ai[l] += ti;
+        }
+      }
+    }
+  }
+
+  // split into the spectrum of the real signal and take the power
+  for (int32_t k = 0; k < kNumFftBins; ++k) {
+    int32_t m = (kHalf - k) & (kHalf - 1);
+    float wr = t.post_re[k];
+    float wi = t.post_im[k];
+    const float *zr = re + k * kL;
+    const float *zi = im + k * kL;
+    const float *cr = re + m * kL;
+    const float *ci = im + m * kL;
+    float *p = power + k * kL;
+    for (int32_t l = 0; l < kL; ++l) {
+      // even = (Z[k] + conj(Z[m])) / 2, odd = (Z[k] - conj(Z[m])) / 2i
+      float er = 0.5f * (zr[l] + cr[l]);
+      float ei = 0.5f * (zi[l] - ci[l]);
+      float or_ = 0.5f * (zi[l] + ci[l]);
+      float oi = -0.5f * (zr[l] - cr[l]);
+      float xr = er + wr * or_ - wi * oi;
+      float xi = ei + wr * oi + wi * or_;
+      p[l] = xr * xr + xi * xi;
+    }
+  }
+
+  // banded mel projection
+  for (int32_t b = 0; b < kNumBins; ++b) {
+    const auto &band = t.bands[b];
+    float *out = mel + b * kL;
+    for (int32_t l = 0; l < kL; ++l) {
+      out[l] = 0;
+    }
+    const float *p = power + band.first * kL;
+    for (size_t j = 0; j < band.weights.size(); ++j, p += kL) {
+      float w = band.weights[j];
+      for (int32_t l = 0; l < kL; ++l) {
+        out[l] += w * p[l];
+      }
+    }
+    for (int32_t l = 0; l < kL; ++l) {
+      out[l] = logf(std::max(out[l], FLT_EPSILON));
+    }
+  }
+}
+
+void ProcessBlockDefault(const Tables &t, float *re, float *im, float *power,
+                         float *mel) {
+  ProcessBlockImpl(t, re, im, power, mel);
+}
+
+#ifdef FBANK_X86
+__attribute__((target("avx2,fma"))) void
+ProcessBlockAvx2(const Tables &t, float *re, float *im, float *power,
+                 float *mel) {
+  ProcessBlockImpl(t, re, im, power, mel);
+}
+#endif
+
+using ProcessBlockFn = void (*)(const Tables &, float *, float *, float *,
+                                float *);
+
+ProcessBlockFn GetProcessBlock() {
+  static const ProcessBlockFn fn = [] {
+#ifdef FBANK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return ProcessBlockAvx2;
+    }
+#endif
+    return ProcessBlockDefault;
+  }();
+  return fn;
+}
+
+} // namespace
+
+FbankComputer &FbankComputer::get() {
+  thread_local FbankComputer inst;
+  return inst;
+}
+
+FbankComputer::FbankComputer()
+    : re_(kHalf * kL), im_(kHalf * kL), power_(kNumFftBins * kL),
+      mel_(kNumBins * kL), window_(kFrameLength) {
+  GetTables();
+}
+
+void FbankComputer::Compute(const Job *jobs, int32_t num_jobs) {
+  int32_t n = 0;
+  for (int32_t j = 0; j < num_jobs; ++j) {
+    for (int32_t f = 0; f < jobs[j].num_frames; ++f) {
+      refs_[n++] = {&jobs[j], jobs[j].first_frame + f};
+      if (n == kL) {
+        ComputeBlock(n);
+        n = 0;
+      }
+    }
+  }
+  if (n > 0) {
+    ComputeBlock(n);
+  }
+}
+
+std::vector<float> FbankComputer::Compute(const float *wave,
+                                          int64_t num_samples) {
+  Job job;
+  job.wave = wave;
+  job.num_samples = num_samples;
+  job.num_frames = NumFrames(num_samples);
+  std::vector<float> out(static_cast<size_t>(job.num_frames) * kNumBins);
+  job.out = out.data();
+  Compute(&job, 1);
+  return out;
+}
+
+void FbankComputer::ComputeBlock(int32_t num) {
+  const Tables &t = GetTables();
+  std::fill(re_.begin(), re_.end(), 0.0f);
+  std::fill(im_.begin(), im_.end(), 0.0f);
+
+  float *w = window_.data();
+  for (int32_t l = 0; l < num; ++l) {
+    const Job &job = *refs_[l].job;
+    int64_t start = FirstSample(refs_[l].frame);
+    int64_t n = job.num_samples;
+
+    // extract with reflection at both ends of the signal
+    float sum = 0;
+    for (int32_t i = 0; i < kFrameLength; ++i) {
+      int64_t s = start + i;
+      while (s < 0 || s >= n) {
+        s = s < 0 ? -s - 1 : 2 * n - 1 - s;
+      }
+      w[i] = job.wave[s - job.offset];
+      sum += w[i];
+    }
+
+    // remove dc offset, pre-emphasis, hamming window
+    float mean = sum / kFrameLength;
+    for (int32_t i = 0; i < kFrameLength; ++i) {
+      w[i] -= mean;
+    }
+    for (int32_t i = kFrameLength - 1; i > 0; --i) {
+      w[i] -= 0.97f * w[i - 1];
+    }
+    w[0] -= 0.97f * w[0];
+    for (int32_t i = 0; i < kFrameLength; ++i) {
+      w[i] *= t.window[i];
+    }
+
+    // pack the real frame as kHalf complex samples, bit reversed, zero
+    // padded to kFftSize
+    for (int32_t i = 0; i < kFrameLength / 2; ++i) {
+      int32_t r = t.bitrev[i];
+      re_[r * kL + l] = w[2 * i];
+      im_[r * kL + l] = w[2 * i + 1];
+    }
+  }
+
+  GetProcessBlock()(t, re_.data(), im_.data(), power_.data(), mel_.data());
+
+  for (int32_t l = 0; l < num; ++l) {
+    const Job &job = *refs_[l].job;
+    float *out = job.out + (refs_[l].frame - job.first_frame) * kNumBins;
+    for (int32_t b = 0; b < kNumBins; ++b) {
+      out[b] = mel_[b * kL + l];
+    }
+  }
+}
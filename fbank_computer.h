@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Kaldi compatible 80-bin log mel filterbank as used by SenseVoice: 16kHz,
+// 25ms hamming window, 10ms shift, no dither, snip_edges=false, dc removal,
+// 0.97 pre-emphasis, 512-point FFT, power spectrum. The output matches
+// knf::OnlineFbank with the options of SenseVoice::recog within float
+// rounding; bench/fbank_parity.cc checks it on scripts/audios.
+//
+// Window, FFT twiddles and mel weights are computed once per process.
+// Frames are processed 8 at a time in a lane-interleaved layout, so the
+// real FFT, power spectrum and mel projection all vectorise across frames.
+// Frames of several utterances can be mixed in one Compute() call.
+class FbankComputer {
+public:
+  static constexpr int32_t kFrameLength = 400; // 25ms
+  static constexpr int32_t kFrameShift = 160;  // 10ms
+  static constexpr int32_t kFftSize = 512;
+  static constexpr int32_t kNumBins = 80;
+  static constexpr int32_t kLanes = 8; // frames per vectorised block
+
+  // Frames [first_frame, first_frame + num_frames) of one signal.
+  // wave[i - offset] is sample i; every sample a requested frame touches
+  // must be present. num_samples is the total length of the signal once it
+  // is complete, needed for the reflection of the last frames only.
+  struct Job {
+    const float *wave = nullptr;
+    int64_t offset = 0;
+    int64_t num_samples = 0;
+    int32_t first_frame = 0;
+    int32_t num_frames = 0;
+    float *out = nullptr; // num_frames x kNumBins
+  };
+
+  // Scratch is per thread, tables are shared
+  static FbankComputer &get();
+
+  // Number of frames of a complete signal
+  static int32_t NumFrames(int64_t num_samples) {
+    return static_cast<int32_t>((num_samples + kFrameShift / 2) / kFrameShift);
+  }
+
+  // Number of frames computable from the first num_samples samples of a
+  // signal that is still arriving
+  static int32_t NumFramesReady(int64_t num_samples) {
+    int64_t first_end = FirstSample(0) + kFrameLength;
+    if (num_samples < first_end) {
+      return 0;
+    }
+    int64_t n = (num_samples - first_end) / kFrameShift + 1;
+    int32_t total = NumFrames(num_samples);
+    return n < total ? static_cast<int32_t>(n) : total;
+  }
+
+  // First sample of frame i, may be negative (reflected)
+  static int64_t FirstSample(int32_t i) {
+    return static_cast<int64_t>(i) * kFrameShift + kFrameShift / 2 -
+           kFrameLength / 2;
+  }
+
+  void Compute(const Job *jobs, int32_t num_jobs);
+
+  // Whole signal in one go: NumFrames(num_samples) x kNumBins
+  std::vector<float> Compute(const float *wave, int64_t num_samples);
+
+private:
+  FbankComputer();
+
+  void ComputeBlock(int32_t num);
+
+  struct FrameRef {
+    const Job *job;
+    int32_t frame;
+  };
+  FrameRef refs_[kLanes];
+
+  // lane interleaved scratch: x[n * kLanes + lane]
+  std::vector<float> re_;
+  std::vector<float> im_;
+  std::vector<float> power_;
+  std::vector<float> mel_;
+  std::vector<float> window_;
+};
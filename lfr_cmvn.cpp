@@ -0,0 +1,116 @@
+#include "lfr_cmvn.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LFR_CMVN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+template <int32_t Window, int32_t Dim>
+void LfrCmvnScalar(const float *const *frames, const float *scale,
+                   const float *bias, float *out) {
+  for (int32_t w = 0; w < Window; ++w) {
+    const float *f = frames[w];
+    for (int32_t j = 0; j < Dim; ++j) {
+      out[j] = f[j] * scale[j] + bias[j];
+    }
+    scale += Dim;
+    bias += Dim;
+    out += Dim;
+  }
+}
+
+void LfrCmvnGeneric(const float *const *frames, int32_t window_size,
+                    int32_t dim, const float *scale, const float *bias,
+                    float *out) {
+  for (int32_t w = 0; w < window_size; ++w) {
+    const float *f = frames[w];
+    for (int32_t j = 0; j < dim; ++j) {
+      out[j] = f[j] * scale[j] + bias[j];
+    }
+    scale += dim;
+    bias += dim;
+    out += dim;
+  }
+}
+
+#ifdef LFR_CMVN_X86
+template <int32_t Window, int32_t Dim>
+__attribute__((target("avx2,fma"))) void
+LfrCmvnAvx2(const float *const *frames, const float *scale, const float *bias,
+            float *out) {
+  static_assert(Dim % 8 == 0, "feature dim must be a multiple of 8");
+  for (int32_t w = 0; w < Window; ++w) {
+    const float *f = frames[w];
+    for (int32_t j = 0; j < Dim; j += 8) {
+      __m256 x = _mm256_loadu_ps(f + j);
+      __m256 s = _mm256_loadu_ps(scale + j);
+      __m256 b = _mm256_loadu_ps(bias + j);
+      _mm256_storeu_ps(out + j, _mm256_fmadd_ps(x, s, b));
+    }
+    scale += Dim;
+    bias += Dim;
+    out += Dim;
+  }
+}
+
+template <int32_t Window, int32_t Dim>
+__attribute__((target("avx512f"))) void
+LfrCmvnAvx512(const float *const *frames, const float *scale,
+              const float *bias, float *out) {
+  static_assert(Dim % 16 == 0, "feature dim must be a multiple of 16");
+  for (int32_t w = 0; w < Window; ++w) {
+    const float *f = frames[w];
+    for (int32_t j = 0; j < Dim; j += 16) {
+      __m512 x = _mm512_loadu_ps(f + j);
+      __m512 s = _mm512_loadu_ps(scale + j);
+      __m512 b = _mm512_loadu_ps(bias + j);
+      _mm512_storeu_ps(out + j, _mm512_fmadd_ps(x, s, b));
+    }
+    scale += Dim;
+    bias += Dim;
+    out += Dim;
+  }
+}
+#endif
+
+using Kernel = void (*)(const float *const *, const float *, const float *,
+                        float *);
+
+struct Dispatch {
+  Kernel kernel_7x80 = LfrCmvnScalar<7, 80>;
+  const char *isa = "scalar";
+
+  Dispatch() {
+#ifdef LFR_CMVN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      kernel_7x80 = LfrCmvnAvx512<7, 80>;
+      isa = "avx512";
+    } else if (__builtin_cpu_supports("avx2") &&
+               __builtin_cpu_supports("fma")) {
+      kernel_7x80 = LfrCmvnAvx2<7, 80>;
+      isa = "avx2";
+    }
+#endif
+  }
+};
+
+const Dispatch &GetDispatch() {
+  static const Dispatch dispatch;
+  return dispatch;
+}
+
+} // namespace
+
+void LfrCmvn(const float *const *frames, int32_t window_size, int32_t dim,
+             const float *scale, const float *bias, float *out) {
+  if (window_size == 7 && dim == 80) {
+    GetDispatch().kernel_7x80(frames, scale, bias, out);
+  } else {
+    LfrCmvnGeneric(frames, window_size, dim, scale, bias, out);
+  }
+}
+
+const char *LfrCmvnIsa() { return GetDispatch().isa; }
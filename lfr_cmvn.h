@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+
+// LFR stacking + CMVN of one output frame:
+//
+//   out[w * dim + j] = frames[w][j] * scale[w * dim + j] + bias[w * dim + j]
+//
+// for w in [0, window_size) and j in [0, dim), where scale = inv_stddev and
+// bias = neg_mean * inv_stddev, i.e. (x + neg_mean) * inv_stddev as one FMA.
+//
+// The 7x80 window of SenseVoice is specialised at compile time. The best of
+// AVX-512, AVX2+FMA and plain C++ is picked once at runtime.
+void LfrCmvn(const float *const *frames, int32_t window_size, int32_t dim,
+             const float *scale, const float *bias, float *out);
+
+// Name of the kernel LfrCmvn() dispatches to, for logs and benchmarks
+const char *LfrCmvnIsa();
@@ -0,0 +1,191 @@
+#include "local_transport.h"
+#include "clog.h"
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+struct LocalListener::Connection {
+  explicit Connection(int fd) : fd(fd) {}
+  ~Connection() { ::close(fd); }
+
+  // One reply is one seqpacket message, so replies from different threads
+  // never interleave.
+  void Send(uint32_t id, uint32_t flags, const std::string &text) {
+    LocalReply reply;
+    reply.id = id;
+    reply.flags = flags;
+    iovec iov[2] = {{&reply, sizeof(reply)},
+                    {const_cast<char *>(text.data()), text.size()}};
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    // the client may be gone already
+    ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+  }
+
+  const int fd;
+  std::shared_ptr<const MappedFile> ring;
+};
+
+LocalListener::LocalListener(const std::string &path, Handler handler)
+    : path_(path), handler_(std::move(handler)) {
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path_.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Unix socket path too long: " + path_);
+  }
+  std::strcpy(addr.sun_path, path_.c_str());
+
+  listen_fd_ = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+  }
+  // left over from a previous run; never remove anything but a socket
+  struct stat st;
+  if (::lstat(path_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    ::unlink(path_.c_str());
+  }
+  // Jobs are accepted from whoever can connect: only our own user. The mode
+  // is set before listen(), so nobody can connect while it is still open.
+  if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr),
+             sizeof(addr)) != 0 ||
+      ::chmod(path_.c_str(), 0600) != 0 || ::listen(listen_fd_, 64) != 0) {
+    int err = errno;
+    ::close(listen_fd_);
+    throw std::runtime_error("listen on " + path_ + ": " + std::strerror(err));
+  }
+  PLOGI << "Listening for local clients on " << path_;
+  accept_thread_ = std::thread(&LocalListener::AcceptLoop, this);
+}
+
+LocalListener::~LocalListener() {
+  ::shutdown(listen_fd_, SHUT_RDWR);
+  accept_thread_.join();
+  ::close(listen_fd_);
+  ::unlink(path_.c_str());
+
+  std::unique_lock<std::mutex> lock(mx_);
+  for (int fd : fds_) {
+    ::shutdown(fd, SHUT_RDWR);
+  }
+  cv_.wait(lock, [this] { return num_readers_ == 0; });
+}
+
+void LocalListener::AcceptLoop() {
+  while (true) {
+    int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break; // shut down
+    }
+    auto con = std::make_shared<Connection>(fd);
+    {
+      std::lock_guard<std::mutex> lock(mx_);
+      fds_.insert(fd);
+      ++num_readers_;
+    }
+    std::thread(&LocalListener::ReadLoop, this, std::move(con)).detach();
+  }
+}
+
+void LocalListener::ReadLoop(std::shared_ptr<Connection> con) {
+  // LocalHello with the ring's memfd
+  LocalHello hello;
+  iovec iov = {&hello, sizeof(hello)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t n = ::recvmsg(con->fd, &msg, MSG_CMSG_CLOEXEC);
+
+  int ring_fd = -1;
+  for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+      std::memcpy(&ring_fd, CMSG_DATA(c), sizeof(int));
+    }
+  }
+
+  std::string error;
+  if (n != sizeof(hello) || hello.magic != kLocalMagic || ring_fd < 0) {
+    error = "Expected LocalHello with a memfd";
+  } else {
+    // The client must not be able to shrink the ring under us: reading a
+    // truncated page would SIGBUS the whole server.
+    struct stat st;
+    int seals = ::fcntl(ring_fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+      error = "The ring must be a memfd sealed with F_SEAL_SHRINK";
+    } else if (::fstat(ring_fd, &st) != 0 || hello.ring_bytes == 0 ||
+               static_cast<uint64_t>(st.st_size) < hello.ring_bytes) {
+      error = "Invalid ring size";
+    } else {
+      try {
+        con->ring = std::make_shared<MappedFile>(ring_fd, hello.ring_bytes);
+      } catch (const std::exception &e) {
+        error = e.what();
+      }
+    }
+  }
+  if (ring_fd >= 0) {
+    ::close(ring_fd);
+  }
+  if (!error.empty()) {
+    con->Send(0, kLocalLast | kLocalError, error);
+  }
+
+  while (error.empty()) {
+    LocalRequest req;
+    n = ::recv(con->fd, &req, sizeof(req), 0);
+    if (n <= 0) {
+      break; // closed
+    }
+    uint64_t size = con->ring->size();
+    if (n != sizeof(req) || req.offset % sizeof(float) != 0 ||
+        req.num_samples == 0 || req.num_samples > INT32_MAX ||
+        req.offset > size ||
+        static_cast<uint64_t>(req.num_samples) * 4 > size - req.offset) {
+      con->Send(req.id, kLocalLast | kLocalError, "Invalid request");
+      continue;
+    }
+    if (req.sample_rate < 1000 || req.sample_rate > 192000) {
+      con->Send(req.id, kLocalLast | kLocalError, "Unsupported sample rate");
+      continue;
+    }
+
+    Request r;
+    r.id = req.id;
+    r.sample_rate = req.sample_rate;
+    r.samples = reinterpret_cast<const float *>(
+        static_cast<const char *>(con->ring->data()) + req.offset);
+    r.num_samples = static_cast<int32_t>(req.num_samples);
+    r.ring = con->ring;
+    uint32_t id = req.id;
+    r.reply = [con, id](const std::string &text, bool last) {
+      con->Send(id, last ? static_cast<uint32_t>(kLocalLast) : 0u, text);
+    };
+    r.fail = [con, id](const std::string &error) {
+      con->Send(id, kLocalLast | kLocalError, error);
+    };
+    handler_(std::move(r));
+  }
+
+  std::lock_guard<std::mutex> lock(mx_);
+  fds_.erase(con->fd);
+  --num_readers_;
+  cv_.notify_all();
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+// Recognition for clients on the same host, without websocket framing,
+// TCP or copies of the audio.
+//
+// The client creates a memfd ring, seals it against shrinking and passes
+// it with the first message. It writes each utterance into the ring as
+// float samples in the int16 range and sends a LocalRequest naming the
+// region; the features stage reads the samples in place. The region stays
+// the server's until the reply flagged kLocalLast for that request.
+//
+// Control messages go over a SOCK_SEQPACKET unix socket, one struct per
+// message:
+//   client -> server: LocalHello (+ the memfd), then LocalRequest ...
+//   server -> client: LocalReply + utf-8 text
+// Texts are what OfflineWebsocketServer sends for the same audio: the
+// transcript, or for audio longer than CONFIG::max_utterance_length one
+// JSON message per segment followed by {"done": true, "segments": n}.
+constexpr uint32_t kLocalMagic = 0x41535231; // "ASR1"
+
+struct LocalHello {
+  uint32_t magic = kLocalMagic;
+  uint32_t reserved = 0;
+  uint64_t ring_bytes = 0; // mapped size of the memfd
+};
+
+struct LocalRequest {
+  uint32_t id = 0;          // echoed in the replies
+  int32_t sample_rate = 0;  // any rate, resampled if not 16kHz
+  uint64_t offset = 0;      // byte offset in the ring, float aligned
+  uint32_t num_samples = 0; // contiguous, the ring does not wrap inside
+  uint32_t reserved = 0;
+};
+
+enum LocalReplyFlags : uint32_t {
+  kLocalLast = 1,  // the request is done, its region may be reused
+  kLocalError = 2, // text is an error message
+};
+
+struct LocalReply {
+  uint32_t id = 0;
+  uint32_t flags = 0;
+};
+
+class MappedFile;
+
+// Server side: accepts local clients on a unix socket path and hands every
+// valid request to a handler. Each client connection has a reader thread;
+// replies may be sent from any thread.
+class LocalListener {
+public:
+  struct Request {
+    uint32_t id;
+    int32_t sample_rate;
+    const float *samples; // in the client's ring
+    int32_t num_samples;
+    std::shared_ptr<const MappedFile> ring; // keeps samples mapped
+    // call with last set exactly once, after the samples were read
+    std::function<void(const std::string &text, bool last)> reply;
+    std::function<void(const std::string &error)> fail;
+  };
+  using Handler = std::function<void(Request &&)>;
+
+  LocalListener(const std::string &path, Handler handler);
+  ~LocalListener();
+
+private:
+  struct Connection;
+  void AcceptLoop();
+  void ReadLoop(std::shared_ptr<Connection> con);
+
+  std::string path_;
+  Handler handler_;
+  int listen_fd_ = -1;
+  std::thread accept_thread_;
+
+  // live client sockets, shut down by the destructor
+  std::mutex mx_;
+  std::condition_variable cv_;
+  std::set<int> fds_;
+  int32_t num_readers_ = 0;
+};
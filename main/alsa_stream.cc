@@ -31,6 +31,8 @@
 #include "alsa.h"
 #include "asr.h"
 #include "clog.h"
+#include "partial_decoder.h"
+#include "sense_voice.h"
 #include "sherpa-display.h" // NOLINT
 // #include "sherpa-onnx/c-api/cxx-api.h"
 
@@ -154,6 +156,7 @@ as the device_name.
   std::string vad_onnx = "silero_vad.onnx";
   auto _sence_voice = std::make_unique<SenseVoice>(asr_onnx, tokens);
   auto _vad = std::make_unique<SileroVAD>(vad_onnx);
+  _vad->KeepSpeech(true); // recognized from Data()
 
   int32_t expected_sample_rate = 16000;
 
@@ -173,7 +176,10 @@ as the device_name.
   std::vector<float> buffer;
   bool speech_started = false;
 
-  auto started_time = std::chrono::steady_clock::now();
+  // partial results reuse the features of the samples already seen instead
+  // of decoding the whole buffer again every time
+  PartialDecoder partial(_sence_voice.get());
+  size_t fed = 0; // samples of buffer already given to partial
 
   SherpaDisplay display;
 
@@ -203,7 +209,8 @@ as the device_name.
       auto vad_pred = _vad->predict(data);
       if (!speech_started && vad_pred == "start") {
         speech_started = true;
-        started_time = std::chrono::steady_clock::now();
+        partial.Reset();
+        fed = 0;
       }
     }
     if (!speech_started) {
@@ -213,18 +220,14 @@ as the device_name.
       }
     }
 
-    auto current_time = std::chrono::steady_clock::now();
-    const float elapsed_seconds =
-        std::chrono::duration_cast<std::chrono::milliseconds>(current_time -
-                                                              started_time)
-            .count() /
-        1000.;
-
-    if (speech_started && elapsed_seconds > 0.2) {
-      auto result = _sence_voice->recog(buffer);
-      display.UpdateText(result);
-      display.Display();
-      started_time = std::chrono::steady_clock::now();
+    if (speech_started) {
+      partial.AcceptWaveform(buffer.data() + fed, buffer.size() - fed);
+      fed = buffer.size();
+      if (partial.Ready()) {
+        auto result = partial.Decode();
+        display.UpdateText(result);
+        display.Display();
+      }
     }
 
 #if 1
@@ -251,6 +254,7 @@ as the device_name.
 
       buffer.clear();
       offset = 0;
+      fed = 0;
       speech_started = false;
     }
 #endif
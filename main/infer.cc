@@ -45,7 +45,7 @@ int main(int argc, char *argv[]) {
     for (auto i : data) {
       tmp.push_back(i * 37268);
     }
-    std::cout << "AsrResult:" << asr->_sence_voice->recog(tmp) << std::endl;
+    std::cout << "AsrResult:" << asr->_recognizer->recog(tmp) << std::endl;
 
     for (int i = 0; i < data.size() / 512; ++i) {
       std::vector<float> tmp(data.begin() + i * 512,
@@ -0,0 +1,531 @@
+/*************************************************************************
+    > File Name: loadgen.cc
+    > Load generator for the websocket server
+ ************************************************************************/
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <websocketpp/client.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+
+#include "clog.h"
+#include "config.h"
+#include "util.h"
+
+// usage: loadgen [options] (--dir d | --manifest f)
+//
+//   --host h --port p       server, localhost:CONFIG::ws_port by default
+//   --dir d                 every .wav in d
+//   --manifest f            one wav path per line (first field)
+//   --concurrency n         closed loop: n connections, each sends its next
+//                           utterance as soon as the last result is in
+//   --rate r                open loop: Poisson arrivals at r requests/s,
+//                           spread over --connections multiplexed ones
+//   --connections n         for --rate, 4 by default
+//   --warmup s --duration s results of the first s seconds are dropped,
+//                           then requests are sent for duration seconds
+//   --format int16|float32  upload encoding, int16 by default
+//   --frame-bytes n         websocket frame size, 10240 by default
+//
+// Prints a summary to stderr and JSON to stdout. Latency runs from the
+// moment a request is due (open loop) or its first frame is sent (closed
+// loop) to its final result, so a server that falls behind an open loop
+// rate is charged for the queueing it causes.
+
+namespace {
+
+typedef websocketpp::client<websocketpp::config::asio_client> client;
+using Clock = std::chrono::steady_clock;
+
+// How long results are waited for once the run is over
+constexpr double kDrainSeconds = 30;
+
+struct Options {
+  std::string host = "localhost";
+  uint16_t port = CONFIG::ws_port;
+  std::string dir;
+  std::string manifest;
+  int32_t concurrency = 0;
+  double rate = 0;
+  int32_t connections = 4;
+  double warmup = 5;
+  double duration = 30;
+  bool int16 = true;
+  size_t frame_bytes = 10240;
+};
+
+// A wav file, encoded once as the server expects it
+struct Utterance {
+  std::string name;
+  double seconds = 0;
+  std::string payload; // 8 byte header + samples
+};
+
+bool Encode(const std::string &path, bool int16, Utterance *u) {
+  std::vector<float> samples;
+  int32_t sample_rate = 16000;
+  if (!load_wav_file(path.c_str(), &sample_rate, samples) ||
+      samples.empty()) {
+    return false;
+  }
+  u->name = path;
+  u->seconds = static_cast<double>(samples.size()) / sample_rate;
+  // the server takes float32 samples in the int16 range as well
+  int32_t bytes = samples.size() * (int16 ? 2 : 4);
+  uint32_t header = sample_rate | (int16 ? 1u << 24 : 0u);
+  u->payload.resize(8 + bytes);
+  char *p = &u->payload[0];
+  std::memcpy(p, &header, 4);
+  std::memcpy(p + 4, &bytes, 4);
+  p += 8;
+  for (float x : samples) {
+    float v = std::max(-32768.0f, std::min(32767.0f, x * 32768));
+    if (int16) {
+      int16_t s = static_cast<int16_t>(v);
+      std::memcpy(p, &s, 2);
+      p += 2;
+    } else {
+      std::memcpy(p, &v, 4);
+      p += 4;
+    }
+  }
+  return true;
+}
+
+std::vector<std::string> ListFiles(const Options &opts) {
+  std::vector<std::string> files;
+  if (!opts.manifest.empty()) {
+    std::ifstream is(opts.manifest);
+    std::string line;
+    while (std::getline(is, line)) {
+      std::istringstream fields(line);
+      std::string path;
+      if (fields >> path && path[0] != '#') {
+        files.push_back(path);
+      }
+    }
+  } else if (DIR *d = opendir(opts.dir.c_str())) {
+    while (dirent *e = readdir(d)) {
+      std::string name = e->d_name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) {
+        files.push_back(opts.dir + "/" + name);
+      }
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+  }
+  return files;
+}
+
+class LoadGen {
+public:
+  LoadGen(const Options &opts, std::vector<Utterance> &&utterances)
+      : opts_(opts), utterances_(std::move(utterances)), timer_(io_),
+        drain_timer_(io_) {
+    client_.clear_access_channels(websocketpp::log::alevel::all);
+    client_.clear_error_channels(websocketpp::log::elevel::all);
+    client_.init_asio(&io_);
+    client_.set_open_handler([this](websocketpp::connection_hdl hdl) {
+      OnOpen(hdl);
+    });
+    client_.set_fail_handler([this](websocketpp::connection_hdl hdl) {
+      OnClose(hdl);
+    });
+    client_.set_close_handler([this](websocketpp::connection_hdl hdl) {
+      OnClose(hdl);
+    });
+    client_.set_message_handler(
+        [this](websocketpp::connection_hdl hdl, client::message_ptr msg) {
+          OnMessage(hdl, msg);
+        });
+  }
+
+  // Everything runs on this thread
+  nlohmann::json Run() {
+    int32_t n = closed_loop() ? opts_.concurrency : opts_.connections;
+    std::string uri =
+        "ws://" + opts_.host + ":" + std::to_string(opts_.port) + "/";
+    for (int32_t i = 0; i < n; ++i) {
+      websocketpp::lib::error_code ec;
+      auto con = client_.get_connection(uri, ec);
+      if (ec) {
+        PLOGE << "connect " << uri << ": " << ec.message();
+        break;
+      }
+      conns_[con->get_handle()].index = i;
+      client_.connect(con);
+      ++num_connections_;
+    }
+    io_.run();
+    return Report();
+  }
+
+private:
+  struct Pending {
+    size_t utterance;
+    Clock::time_point start;
+  };
+  struct Conn {
+    int32_t index = 0;
+    bool open = false;
+    // by request id; closed loop connections use id 0 only
+    std::map<uint32_t, Pending> pending;
+  };
+  struct Done {
+    double latency; // seconds
+    double seconds; // of audio
+    Clock::time_point end;
+  };
+
+  bool closed_loop() const { return opts_.concurrency > 0; }
+
+  void OnOpen(websocketpp::connection_hdl hdl) {
+    conns_[hdl].open = true;
+    ++num_resolved_;
+    MaybeStart();
+  }
+
+  void OnClose(websocketpp::connection_hdl hdl) {
+    auto it = conns_.find(hdl);
+    if (it == conns_.end()) {
+      return;
+    }
+    Conn &conn = it->second;
+    if (!conn.open) {
+      PLOGE << "connection " << conn.index << " failed";
+      ++num_resolved_; // do not wait for it
+    } else if (!conn.pending.empty()) {
+      PLOGE << "connection " << conn.index << " lost with "
+            << conn.pending.size() << " requests pending";
+      errors_ += conn.pending.size();
+    }
+    conns_.erase(it);
+    if (conns_.empty()) {
+      timer_.cancel();
+    } else if (!started()) {
+      MaybeStart();
+    } else {
+      MaybeStop();
+    }
+  }
+
+  // Starts the clock once every connection is open or has failed
+  void MaybeStart() {
+    if (started() || num_resolved_ < num_connections_ || conns_.empty()) {
+      return;
+    }
+    start_ = Clock::now();
+    measure_ = start_ + Seconds(opts_.warmup);
+    stop_ = measure_ + Seconds(opts_.duration);
+    drain_timer_.expires_at(stop_ + Seconds(kDrainSeconds));
+    drain_timer_.async_wait([this](const asio::error_code &ec) {
+      if (ec) {
+        return;
+      }
+      // give up on what is still pending
+      for (auto &kv : conns_) {
+        timeouts_ += kv.second.pending.size();
+        kv.second.pending.clear();
+      }
+      MaybeStop();
+    });
+    if (closed_loop()) {
+      for (auto &kv : conns_) {
+        SendNext(kv.first, kv.second, 0, Clock::now());
+      }
+    } else {
+      next_arrival_ = start_;
+      ScheduleArrival();
+    }
+  }
+
+  bool started() const { return start_ != Clock::time_point(); }
+
+  void OnMessage(websocketpp::connection_hdl hdl, client::message_ptr msg) {
+    auto it = conns_.find(hdl);
+    if (it == conns_.end()) {
+      return;
+    }
+    Conn &conn = it->second;
+    const std::string &text = msg->get_payload();
+    uint32_t id = 0;
+    if (!text.empty() && text[0] == '{') {
+      auto j = nlohmann::json::parse(text, nullptr, false);
+      if (j.is_discarded() || j.contains("segment")) {
+        return; // long uploads: wait for {"done"}
+      }
+      if (j.contains("id")) {
+        id = j["id"].get<uint32_t>();
+      }
+    }
+    auto p = conn.pending.find(id);
+    if (p == conn.pending.end()) {
+      return;
+    }
+    auto now = Clock::now();
+    const Utterance &u = utterances_[p->second.utterance];
+    if (p->second.start >= measure_) {
+      done_.push_back({Seconds(now - p->second.start), u.seconds, now});
+    }
+    conn.pending.erase(p);
+    if (closed_loop() && now < stop_) {
+      SendNext(hdl, conn, 0, now);
+    }
+    MaybeStop();
+  }
+
+  // Sends the next utterance as request id, tagged unless closed loop
+  void SendNext(websocketpp::connection_hdl hdl, Conn &conn, uint32_t id,
+                Clock::time_point due) {
+    size_t k = next_utterance_++ % utterances_.size();
+    const std::string &payload = utterances_[k].payload;
+    conn.pending[id] = {k, due};
+    uint32_t tag = 0x80000000u | id;
+    std::string frame;
+    for (size_t off = 0; off < payload.size(); off += opts_.frame_bytes) {
+      size_t n = std::min(opts_.frame_bytes, payload.size() - off);
+      frame.clear();
+      if (!closed_loop()) {
+        frame.append(reinterpret_cast<const char *>(&tag), 4);
+      }
+      frame.append(payload, off, n);
+      websocketpp::lib::error_code ec;
+      client_.send(hdl, frame.data(), frame.size(),
+                   websocketpp::frame::opcode::binary, ec);
+      if (ec) {
+        PLOGE << "send: " << ec.message();
+        return;
+      }
+    }
+  }
+
+  void ScheduleArrival() {
+    std::exponential_distribution<double> gap(opts_.rate);
+    next_arrival_ += Seconds(gap(rng_));
+    if (next_arrival_ >= stop_) {
+      // the last results may be in before then, with nothing left to wake
+      // MaybeStop() but the drain timer
+      timer_.expires_at(stop_);
+      timer_.async_wait([this](const asio::error_code &ec) {
+        if (!ec) {
+          MaybeStop();
+        }
+      });
+      return;
+    }
+    timer_.expires_at(next_arrival_);
+    timer_.async_wait([this](const asio::error_code &ec) {
+      if (ec || conns_.empty()) {
+        return;
+      }
+      // round robin over the connections still open
+      auto it = conns_.begin();
+      std::advance(it, next_conn_++ % conns_.size());
+      SendNext(it->first, it->second, next_id_++ & 0x7FFFFFFF,
+               next_arrival_);
+      ScheduleArrival();
+    });
+  }
+
+  // Closes everything once the run is over and nothing is pending
+  void MaybeStop() {
+    if (stopping_ || !started() || Clock::now() < stop_) {
+      return;
+    }
+    for (auto &kv : conns_) {
+      if (!kv.second.pending.empty()) {
+        return;
+      }
+    }
+    stopping_ = true;
+    timer_.cancel();
+    drain_timer_.cancel();
+    for (auto &kv : conns_) {
+      websocketpp::lib::error_code ec;
+      client_.send(kv.first, "Done", websocketpp::frame::opcode::text, ec);
+    }
+  }
+
+  nlohmann::json Report() const {
+    std::vector<double> latency, rtf;
+    double audio = 0;
+    int64_t in_window = 0;
+    for (auto &d : done_) {
+      latency.push_back(d.latency);
+      rtf.push_back(d.latency / d.seconds);
+      audio += d.seconds;
+      in_window += d.end <= stop_;
+    }
+    std::sort(latency.begin(), latency.end());
+    std::sort(rtf.begin(), rtf.end());
+    auto percentiles = [](const std::vector<double> &v, double scale) {
+      nlohmann::json j;
+      if (v.empty()) {
+        return j;
+      }
+      auto at = [&v](double q) {
+        size_t rank = static_cast<size_t>(std::ceil(q * v.size()));
+        return v[std::min(v.size() - 1, rank > 0 ? rank - 1 : 0)];
+      };
+      double sum = 0;
+      for (double x : v) {
+        sum += x;
+      }
+      j["mean"] = sum / v.size() * scale;
+      j["p50"] = at(0.5) * scale;
+      j["p90"] = at(0.9) * scale;
+      j["p99"] = at(0.99) * scale;
+      j["p99.9"] = at(0.999) * scale;
+      j["max"] = v.back() * scale;
+      return j;
+    };
+
+    nlohmann::json out;
+    out["mode"] = closed_loop() ? "closed" : "open";
+    if (closed_loop()) {
+      out["concurrency"] = opts_.concurrency;
+    } else {
+      out["rate"] = opts_.rate;
+      out["connections"] = opts_.connections;
+    }
+    out["utterances"] = utterances_.size();
+    out["warmup_s"] = opts_.warmup;
+    out["duration_s"] = opts_.duration;
+    out["requests"] = done_.size();
+    out["errors"] = errors_;
+    out["timeouts"] = timeouts_;
+    // completions inside the measured window over its length
+    out["throughput_rps"] = in_window / opts_.duration;
+    out["audio_s_per_s"] = audio / opts_.duration;
+    out["latency_ms"] = percentiles(latency, 1e3);
+    out["rtf"] = percentiles(rtf, 1);
+
+    fprintf(stderr,
+            "%s loop: %zu requests, %lld errors, %lld timeouts, %.1f req/s\n",
+            closed_loop() ? "closed" : "open", done_.size(),
+            static_cast<long long>(errors_), static_cast<long long>(timeouts_),
+            in_window / opts_.duration);
+    if (!latency.empty()) {
+      auto &l = out["latency_ms"];
+      fprintf(stderr,
+              "latency ms: p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+              l["p50"].get<double>(), l["p90"].get<double>(),
+              l["p99"].get<double>(), l["p99.9"].get<double>(),
+              l["max"].get<double>());
+      fprintf(stderr, "rtf: mean %.4f p50 %.4f p99 %.4f\n",
+              out["rtf"]["mean"].get<double>(),
+              out["rtf"]["p50"].get<double>(),
+              out["rtf"]["p99"].get<double>());
+    }
+    return out;
+  }
+
+  static Clock::duration Seconds(double s) {
+    return std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(s));
+  }
+  static double Seconds(Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  }
+
+  const Options opts_;
+  const std::vector<Utterance> utterances_;
+
+  asio::io_context io_;
+  client client_;
+  asio::steady_timer timer_;       // next open loop arrival
+  asio::steady_timer drain_timer_; // end of the wait for late results
+  std::map<websocketpp::connection_hdl, Conn,
+           std::owner_less<websocketpp::connection_hdl>>
+      conns_;
+  int32_t num_connections_ = 0;
+  int32_t num_resolved_ = 0; // open or failed
+
+  Clock::time_point start_, measure_, stop_;
+  bool stopping_ = false;
+  size_t next_utterance_ = 0;
+
+  // open loop
+  std::mt19937_64 rng_{42};
+  Clock::time_point next_arrival_;
+  uint32_t next_id_ = 0;
+  size_t next_conn_ = 0;
+
+  std::vector<Done> done_;
+  int64_t errors_ = 0;
+  int64_t timeouts_ = 0;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--host" && has_value) {
+      opts.host = argv[++i];
+    } else if (arg == "--port" && has_value) {
+      opts.port = std::stoi(argv[++i]);
+    } else if (arg == "--dir" && has_value) {
+      opts.dir = argv[++i];
+    } else if (arg == "--manifest" && has_value) {
+      opts.manifest = argv[++i];
+    } else if (arg == "--concurrency" && has_value) {
+      opts.concurrency = std::stoi(argv[++i]);
+    } else if (arg == "--rate" && has_value) {
+      opts.rate = std::stod(argv[++i]);
+    } else if (arg == "--connections" && has_value) {
+      opts.connections = std::stoi(argv[++i]);
+    } else if (arg == "--warmup" && has_value) {
+      opts.warmup = std::stod(argv[++i]);
+    } else if (arg == "--duration" && has_value) {
+      opts.duration = std::stod(argv[++i]);
+    } else if (arg == "--format" && has_value) {
+      opts.int16 = std::string(argv[++i]) != "float32";
+    } else if (arg == "--frame-bytes" && has_value) {
+      opts.frame_bytes = std::stoul(argv[++i]);
+    } else {
+      PLOGE << "unknown option " << arg << ", see main/loadgen.cc";
+      return 1;
+    }
+  }
+  if ((opts.concurrency > 0) == (opts.rate > 0) ||
+      opts.dir.empty() == opts.manifest.empty() || opts.duration <= 0 ||
+      opts.connections <= 0 || opts.frame_bytes == 0) {
+    PLOGE << "usage: " << argv[0]
+          << " (--concurrency n | --rate r) (--dir d | --manifest f)"
+             " [--warmup s] [--duration s] ...";
+    return 1;
+  }
+
+  std::vector<Utterance> utterances;
+  for (auto &path : ListFiles(opts)) {
+    Utterance u;
+    if (Encode(path, opts.int16, &u)) {
+      utterances.push_back(std::move(u));
+    } else {
+      PLOGE << "Failed to read " << path;
+    }
+  }
+  if (utterances.empty()) {
+    PLOGE << "No utterances";
+    return 1;
+  }
+
+  LoadGen gen(opts, std::move(utterances));
+  printf("%s\n", gen.Run().dump(2).c_str());
+  return 0;
+}
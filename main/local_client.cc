@@ -0,0 +1,189 @@
+/*************************************************************************
+    > File Name: local_client.cc
+    > Stand-in client of the shared memory transport, see local_transport.h
+ ************************************************************************/
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "clog.h"
+#include "config.h"
+#include "local_transport.h"
+#include "util.h"
+
+// usage: local_client [--socket path] [--ring-mb n] a.wav b.wav ...
+//
+// Writes every file into the ring and sends all requests at once, waiting
+// for replies only when the ring is full; prints each transcript with the
+// time since it was sent.
+int main(int argc, char *argv[]) {
+  std::string path = CONFIG::local_socket;
+  size_t ring_bytes = 64 << 20;
+  std::vector<std::string> wavs;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--socket" && i + 1 < argc) {
+      path = argv[++i];
+    } else if (arg == "--ring-mb" && i + 1 < argc) {
+      ring_bytes = std::stoul(argv[++i]) << 20;
+    } else {
+      wavs.push_back(arg);
+    }
+  }
+  if (wavs.empty() || path.empty()) {
+    PLOGE << "usage: " << argv[0]
+          << " [--socket path] [--ring-mb n] a.wav ...";
+    return -1;
+  }
+
+  // the ring, sealed so the server can trust its size
+  int ring_fd = memfd_create("asr-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (ring_fd < 0 || ftruncate(ring_fd, ring_bytes) != 0 ||
+      fcntl(ring_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+    PLOGE << "memfd: " << std::strerror(errno);
+    return 1;
+  }
+  auto *ring = static_cast<float *>(mmap(nullptr, ring_bytes,
+                                         PROT_READ | PROT_WRITE, MAP_SHARED,
+                                         ring_fd, 0));
+  if (ring == MAP_FAILED) {
+    PLOGE << "mmap: " << std::strerror(errno);
+    return 1;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    PLOGE << "connect " << path << ": " << std::strerror(errno);
+    return 1;
+  }
+
+  LocalHello hello;
+  hello.ring_bytes = ring_bytes;
+  iovec iov = {&hello, sizeof(hello)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr *c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(c), &ring_fd, sizeof(int));
+  if (sendmsg(fd, &msg, 0) != sizeof(hello)) {
+    PLOGE << "sendmsg: " << std::strerror(errno);
+    return 1;
+  }
+
+  struct Pending {
+    size_t begin, end; // in samples
+    std::chrono::steady_clock::time_point sent;
+  };
+  std::map<uint32_t, Pending> pending;
+  size_t capacity = ring_bytes / sizeof(float);
+  size_t head = 0;
+
+  // Receives one reply, returns false once the server went away
+  auto receive = [&]() {
+    std::vector<char> buf(sizeof(LocalReply) + (1 << 20));
+    ssize_t n = recv(fd, buf.data(), buf.size(), 0);
+    if (n < static_cast<ssize_t>(sizeof(LocalReply))) {
+      return false;
+    }
+    LocalReply reply;
+    std::memcpy(&reply, buf.data(), sizeof(reply));
+    std::string text(buf.data() + sizeof(reply), n - sizeof(reply));
+    auto it = pending.find(reply.id);
+    double ms = 0;
+    if (it != pending.end()) {
+      ms = std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - it->second.sent)
+               .count();
+    }
+    const std::string &name =
+        reply.id < wavs.size() ? wavs[reply.id] : std::string("?");
+    if (reply.flags & kLocalError) {
+      PLOGE << name << ": " << text;
+    } else {
+      PLOGI << "Results: " << name << " " << text << " " << ms << "ms";
+    }
+    if ((reply.flags & kLocalLast) && it != pending.end()) {
+      pending.erase(it);
+    }
+    return true;
+  };
+  auto overlaps = [&](size_t begin, size_t end) {
+    for (auto &p : pending) {
+      if (begin < p.second.end && p.second.begin < end) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  for (uint32_t id = 0; id < wavs.size(); ++id) {
+    std::vector<float> data;
+    int32_t sample_rate = 16000;
+    if (!load_wav_file(wavs[id].c_str(), &sample_rate, data)) {
+      PLOGE << "Failed to read " << wavs[id];
+      continue;
+    }
+    if (data.empty() || data.size() > capacity) {
+      PLOGE << wavs[id] << ": does not fit the ring";
+      continue;
+    }
+    // utterances are contiguous, so wrap early rather than split one
+    if (head + data.size() > capacity) {
+      head = 0;
+    }
+    while (overlaps(head, head + data.size())) {
+      if (!receive()) {
+        PLOGE << "Server closed the connection";
+        return 1;
+      }
+    }
+    // the server expects the int16 range
+    for (size_t i = 0; i < data.size(); ++i) {
+      ring[head + i] = data[i] * 32768;
+    }
+
+    LocalRequest req;
+    req.id = id;
+    req.sample_rate = sample_rate;
+    req.offset = head * sizeof(float);
+    req.num_samples = data.size();
+    pending[id] = {head, head + data.size(), std::chrono::steady_clock::now()};
+    if (send(fd, &req, sizeof(req), 0) != sizeof(req)) {
+      PLOGE << "send: " << std::strerror(errno);
+      return 1;
+    }
+    head += data.size();
+  }
+
+  while (!pending.empty()) {
+    if (!receive()) {
+      PLOGE << "Server closed the connection";
+      return 1;
+    }
+  }
+  close(fd);
+  munmap(ring, ring_bytes);
+  close(ring_fd);
+  return 0;
+}
@@ -5,17 +5,17 @@
     > Created Time: 2025年05月07日 星期三 17时50分30秒
  ************************************************************************/
 #include "config.h"
+#include "prefork.h"
 #include "ws_server.h"
 
-int main(int argc, char *argv[]) {
+static int Serve(bool reuse_port, const std::string &local_socket) {
   asio::io_context io_conn; // for network connections
-  asio::io_context io_work; // for neural network and decoding
-                            //
-  OfflineWebsocketServer s(io_conn, io_work);
-  s.Run(CONFIG::ws_port);
-
-  // give some work to do for the io_work pool
-  auto work_guard = asio::make_work_guard(io_work);
+  // features, neural network and decoding run on the server's own stages
+  OfflineWebsocketServer s(io_conn);
+  s.Run(CONFIG::ws_port, reuse_port);
+  if (!local_socket.empty()) {
+    s.RunLocal(local_socket);
+  }
 
   std::vector<std::thread> io_threads;
 
@@ -24,19 +24,26 @@ int main(int argc, char *argv[]) {
     io_threads.emplace_back([&io_conn]() { io_conn.run(); });
   }
 
-  std::vector<std::thread> work_threads;
-  for (int32_t i = 0; i < CONFIG::num_work_threads; ++i) {
-    work_threads.emplace_back([&io_work]() { io_work.run(); });
-  }
-
   io_conn.run();
 
   for (auto &t : io_threads) {
     t.join();
   }
 
-  for (auto &t : work_threads) {
-    t.join();
-  }
   return 0;
 }
+
+int main(int argc, char *argv[]) {
+  if (CONFIG::num_workers > 0) {
+    // each worker loads the model itself, after the fork: onnxruntime's
+    // threads do not survive one
+    return RunPrefork(CONFIG::num_workers, [](int32_t index) {
+      std::string local_socket = CONFIG::local_socket;
+      if (!local_socket.empty()) {
+        local_socket += "." + std::to_string(index);
+      }
+      return Serve(true, local_socket);
+    });
+  }
+  return Serve(false, CONFIG::local_socket);
+}
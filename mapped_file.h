@@ -0,0 +1,66 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// A file mapped read only and shared. Every process that maps the same
+// file reads the same page cache pages, so N server workers hold one copy
+// of whatever is used from the mapping in place (a .ort model, see
+// OnnxSession) instead of N.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::runtime_error("open " + path + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      int err = errno;
+      ::close(fd);
+      throw std::runtime_error("stat " + path + ": " + std::strerror(err));
+    }
+    try {
+      Map(fd, st.st_size, path);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd); // the mapping keeps the file referenced
+    // the whole model is read while building the session
+    ::madvise(_data, _size, MADV_WILLNEED);
+  }
+
+  // Maps size bytes of an open descriptor, e.g. a memfd passed by another
+  // process. fd is not taken over.
+  MappedFile(int fd, size_t size) { Map(fd, size, "fd"); }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() {
+    if (_data) {
+      ::munmap(_data, _size);
+    }
+  }
+
+  const void *data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  void Map(int fd, size_t size, const std::string &what) {
+    _size = size;
+    _data = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    if (_data == MAP_FAILED) {
+      _data = nullptr;
+      throw std::runtime_error("mmap " + what + ": " + std::strerror(errno));
+    }
+  }
+
+  void *_data = nullptr;
+  size_t _size = 0;
+};
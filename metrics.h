@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Prometheus style histogram. Observe() is two relaxed atomic adds, so it
+// can stay on in the hot path; readers see per bucket (not cumulative)
+// counts.
+class Histogram {
+public:
+  explicit Histogram(std::vector<double> bounds)
+      : bounds_(std::move(bounds)),
+        counts_(new std::atomic<uint64_t>[bounds_.size() + 1]) {
+    for (size_t i = 0; i <= bounds_.size(); ++i) {
+      counts_[i] = 0;
+    }
+  }
+
+  void Observe(double v) {
+    size_t i = 0;
+    while (i < bounds_.size() && v > bounds_[i]) {
+      ++i;
+    }
+    counts_[i].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(static_cast<uint64_t>(v * kSumScale),
+                   std::memory_order_relaxed);
+  }
+
+  // upper bounds, the last bucket (index bounds().size()) is +Inf
+  const std::vector<double> &bounds() const { return bounds_; }
+  uint64_t count(size_t bucket) const {
+    return counts_[bucket].load(std::memory_order_relaxed);
+  }
+  double sum() const {
+    return sum_.load(std::memory_order_relaxed) / kSumScale;
+  }
+
+  // seconds, 0.5ms to 10s
+  static std::vector<double> LatencyBuckets() {
+    return {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+            0.1,    0.25,  0.5,    1,     2.5,  5,     10};
+  }
+
+private:
+  static constexpr double kSumScale = 1e9; // fixed point, values are >= 0
+
+  const std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> counts_;
+  std::atomic<uint64_t> sum_{0};
+};
+
+// Counters of one pipeline stage. Updated with relaxed atomics from the
+// stage's own threads, read by the reporter.
+struct StageMetrics {
+  StageMetrics(const std::string &name, int threads)
+      : name(name), threads(threads) {}
+
+  const std::string name;
+  const int threads;
+  std::atomic<uint64_t> items{0};   // finished work items
+  std::atomic<uint64_t> busy_ns{0}; // time spent working, summed over threads
+  std::atomic<uint64_t> wait_ns{0}; // time items spent queued before the stage
+  std::function<size_t()> depth;    // current queue depth, optional
+  Histogram busy_seconds{Histogram::LatencyBuckets()};
+  Histogram wait_seconds{Histogram::LatencyBuckets()};
+
+  void add(uint64_t busy, uint64_t wait) {
+    items.fetch_add(1, std::memory_order_relaxed);
+    busy_ns.fetch_add(busy, std::memory_order_relaxed);
+    wait_ns.fetch_add(wait, std::memory_order_relaxed);
+    busy_seconds.Observe(busy / 1e9);
+    wait_seconds.Observe(wait / 1e9);
+  }
+};
+
+// Batches run by an OnnxSession
+struct BatchMetrics {
+  Histogram size{{1, 2, 3, 4, 5, 6, 8, 12, 16, 24, 32}};
+  // padded frames over all frames of the batch
+  Histogram padding{{0.05, 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9}};
+  Histogram run_seconds{Histogram::LatencyBuckets()};
+};
+
+// Per request: seconds from the last byte received to the transcript sent,
+// over seconds of audio
+struct RequestMetrics {
+  Histogram rtf{{0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1, 2, 5}};
+  std::atomic<uint64_t> audio_ms{0};
+
+  void add(double latency_s, double audio_s) {
+    if (audio_s > 0) {
+      rtf.Observe(latency_s / audio_s);
+    }
+    audio_ms.fetch_add(static_cast<uint64_t>(audio_s * 1e3),
+                       std::memory_order_relaxed);
+  }
+};
+
+// Audio before and after the silence trimming of offline requests
+struct TrimMetrics {
+  std::atomic<uint64_t> utterances{0};
+  std::atomic<uint64_t> input_ms{0};
+  std::atomic<uint64_t> kept_ms{0};
+
+  void add(uint64_t input, uint64_t kept) {
+    utterances.fetch_add(1, std::memory_order_relaxed);
+    input_ms.fetch_add(input, std::memory_order_relaxed);
+    kept_ms.fetch_add(kept, std::memory_order_relaxed);
+  }
+};
+
+// Lookups in the transcript cache and its current size
+struct CacheMetrics {
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> entries{0};
+  std::atomic<uint64_t> bytes{0};
+};
+
+inline uint64_t elapsed_ns(std::chrono::steady_clock::time_point from,
+                           std::chrono::steady_clock::time_point to =
+                               std::chrono::steady_clock::now()) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from)
+      .count();
+}
@@ -5,7 +5,9 @@
     > Created Time: 2025年07月08日 星期二 15时34分18秒
  ************************************************************************/
 #include "onnx_engine.h"
+#include "trace.h"
 #include "util.h"
+#include <algorithm>
 #include <iostream>
 #include <onnxruntime_cxx_api.h>
 #include <string>
@@ -46,6 +48,7 @@ Ort::Value make_tensor(std::vector<std::shared_ptr<Request>> &reqs,
 
 void OnnxSession::forward(std::vector<std::shared_ptr<Request>> &reqs) {
   PLOGD << "Audio Batch Size: " << reqs.size();
+  auto start = std::chrono::steady_clock::now();
   std::vector<Ort::Value> input_orts;
   for (int i = 0; i < _input_names.size(); ++i) {
     input_orts.push_back(make_tensor(reqs, i));
@@ -55,12 +58,45 @@ void OnnxSession::forward(std::vector<std::shared_ptr<Request>> &reqs) {
       {}, _input_names.data(), input_orts.data(), input_orts.size(),
       _output_names.data(), _output_names.size()));
 
-  for (int i = 0; i < reqs.size(); ++i) {
-    PLOGI << "assign:" << i << " " << output_tensors.get();
-    reqs[i]->_output_arrays = output_tensors;
-    reqs[i]->_output_index = i;
+  auto end = std::chrono::steady_clock::now();
+  uint64_t run_ns = elapsed_ns(start, end);
+  uint64_t busy = run_ns / reqs.size();
+
+  // every input is padded along its first axis to the longest request
+  int64_t max_frames = 0, frames = 0;
+  for (auto &req : reqs) {
+    int64_t t = req->_input_arrays[0].shape[0];
+    max_frames = std::max(max_frames, t);
+    frames += t;
+  }
+  _batch_metrics.size.Observe(reqs.size());
+  _batch_metrics.run_seconds.Observe(run_ns / 1e9);
+  if (max_frames > 0) {
+    _batch_metrics.padding.Observe(
+        1.0 - static_cast<double>(frames) / (max_frames * reqs.size()));
+  }
+  {
+    // under the lock, or addReq() may miss the notification
+    std::lock_guard<std::mutex> lock(_notice_mutex);
+    for (int i = 0; i < reqs.size(); ++i) {
+      PLOGD << "assign:" << i << " " << output_tensors.get();
+      reqs[i]->_output_arrays = output_tensors;
+      reqs[i]->_output_index = i;
+    }
   }
   _notice_cv.notify_all();
+
+  for (auto &req : reqs) {
+    _metrics.add(busy, elapsed_ns(req->_enqueued, start));
+    Tracer::get().Record(req->_trace_id, "inference.queue", req->_enqueued,
+                         start);
+    Tracer::get().Record(req->_trace_id, "inference.run", start, end);
+    auto done = std::move(req->_on_done);
+    req->_on_done = nullptr;
+    if (done) {
+      done();
+    }
+  }
 }
 
 OnnxSession::OnnxSession(const std::string &model_path) {
@@ -68,16 +104,41 @@ OnnxSession::OnnxSession(const std::string &model_path) {
   _env = Ort::Env(ORT_LOGGING_LEVEL_WARNING, "test");
   _session_options.SetIntraOpNumThreads(8);
   _session_options.SetInterOpNumThreads(1);
-  _session = std::make_unique<Ort::Session>(_env, model_path.c_str(),
-                                            _session_options);
+
+  // Only a .ort model lets processes serving the same file share its
+  // weights: it is used in place from the shared mapping, initializers
+  // included, and prepacking is disabled, since the CPU provider would
+  // otherwise copy the constant (quantized) MatMul weights into private
+  // buffers of its own layout. That trades some MatMul speed for memory.
+  // An .onnx model, such as the default CONFIG::asr_onnx, is parsed into
+  // private memory by every process whatever we do, so its mapping is
+  // dropped once the session is built.
+  _model = std::make_unique<MappedFile>(model_path);
+  bool ort_format = model_path.size() > 4 &&
+                    model_path.compare(model_path.size() - 4, 4, ".ort") == 0;
+  if (ort_format) {
+    _session_options.AddConfigEntry("session.use_ort_model_bytes_directly",
+                                    "1");
+    _session_options.AddConfigEntry(
+        "session.use_ort_model_bytes_for_initializers", "1");
+    _session_options.AddConfigEntry("session.disable_prepacking", "1");
+  }
+  _session = std::make_unique<Ort::Session>(_env, _model->data(),
+                                            _model->size(), _session_options);
+  if (!ort_format) {
+    _model.reset();
+  }
+}
+
+void OnnxSession::addReqAsync(std::shared_ptr<Request> req) {
+  req->_enqueued = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(_mutex);
+  _reqs.push_back(req);
+  _cv.notify_all();
 }
 
 void OnnxSession::addReq(std::shared_ptr<Request> req) {
-  {
-    std::lock_guard<std::mutex> lock(_mutex);
-    _reqs.push_back(req);
-    _cv.notify_all();
-  }
+  addReqAsync(req);
 
   {
     std::unique_lock<std::mutex> lock(_notice_mutex);
@@ -89,16 +150,36 @@ void OnnxSession::addReq(std::shared_ptr<Request> req) {
 void OnnxSession::init() {
   setupIO();
   getCustomMetadataMap(_meta_data);
-  for (int i = 0; i < 8; ++i) {
+  _metrics.depth = [this] {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _reqs.size();
+  };
+  for (int i = 0; i < kNumLoops; ++i) {
     _loops.emplace_back([this] {
+      Tracer::get().SetThreadName("inference");
       while (_running.load()) {
         std::vector<std::shared_ptr<Request>> reqs;
         {
           std::unique_lock<std::mutex> lock(_mutex);
-          // _cv.wait_for(lock, std::chrono::milliseconds(20),
-          //              [&] { return _reqs.size() > 2; });
           _cv.wait(lock, [&] { return _reqs.size() > 0; });
-          reqs.swap(_reqs);
+          if (_policy.max_wait.count() > 0) {
+            auto deadline = _reqs.front()->_enqueued + _policy.max_wait;
+            _cv.wait_until(lock, deadline, [&] {
+              return _reqs.empty() || (_policy.max_batch > 0 &&
+                                       _reqs.size() >= _policy.max_batch);
+            });
+          }
+          size_t n = _reqs.size();
+          if (_policy.max_batch > 0 && n > _policy.max_batch) {
+            n = _policy.max_batch;
+          }
+          if (n == _reqs.size()) {
+            reqs.swap(_reqs);
+          } else {
+            reqs.assign(_reqs.begin(), _reqs.begin() + n);
+            _reqs.erase(_reqs.begin(), _reqs.begin() + n);
+            _cv.notify_one(); // the rest is for another loop
+          }
         }
         if (reqs.size() > 0) {
           forward(reqs);
@@ -108,6 +189,12 @@ void OnnxSession::init() {
   }
 }
 
+void OnnxSession::set_batch_policy(const BatchPolicy &policy) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _policy = policy;
+  _cv.notify_all();
+}
+
 void OnnxSession::setupIO() {
   Ort::AllocatorWithDefaultOptions allocator;
 
@@ -177,6 +264,6 @@ void OnnxSession::getCustomMetadataMap(
 
 void OnnxEngine::addModel(const std::string &name,
                           std::unique_ptr<OnnxSession> &&session) {
-
+  std::lock_guard<std::mutex> lock(_mutex);
   _sessions[name] = std::move(session);
 }
@@ -7,6 +7,7 @@
 #pragma once
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <map>
@@ -16,6 +17,9 @@
 #include <string>
 #include <thread>
 
+#include "mapped_file.h"
+#include "metrics.h"
+
 struct ArrayWithShape {
   std::vector<float> data_float;
   std::vector<int32_t> data_int32;
@@ -35,6 +39,12 @@ struct Request {
   // output
   std::shared_ptr<std::vector<Ort::Value>> _output_arrays = nullptr;
   int _output_index = 0;
+
+  // Called on the session thread once the outputs are set, if given. It is
+  // released right after, so it may hold a reference to the request itself.
+  std::function<void()> _on_done;
+  std::chrono::steady_clock::time_point _enqueued;
+  uint64_t _trace_id = 0; // see Tracer, traced as inference.queue/.run
 };
 
 template <typename T>
@@ -88,6 +98,20 @@ Ort::Value PadSequence(OrtAllocator *allocator, std::vector<Ort::Value> &values,
   // TODO(fangjun): Check that the returned value is correct.
 }
 
+// Input feat_id of every request, padded along the first axis into one
+// batch tensor
+Ort::Value make_tensor(std::vector<std::shared_ptr<Request>> &reqs,
+                       int feat_id);
+
+// How the session loops form batches: a loop takes up to max_batch of the
+// queued requests (all of them if 0), first waiting up to max_wait after the
+// oldest one was queued for more to arrive. The default runs whatever is
+// queued at once.
+struct BatchPolicy {
+  size_t max_batch = 0;
+  std::chrono::microseconds max_wait{0};
+};
+
 class OnnxSession {
 public:
   OnnxSession(const std::string &model_path); // json format
@@ -104,11 +128,24 @@ public:
   virtual void forward(std::vector<std::shared_ptr<Request>> &reqs);
 
   std::atomic<bool> _running = true;
+  // a .ort session points into the mapping: declared first, freed last;
+  // null for .onnx models, which are copied
+  std::unique_ptr<MappedFile> _model;
   Ort::Env _env;
   Ort::SessionOptions _session_options;
   std::unique_ptr<Ort::Session> _session;
+  // blocks until req has its outputs
   void addReq(std::shared_ptr<Request> req);
+  // returns at once, req->_on_done is called when the outputs are ready
+  void addReqAsync(std::shared_ptr<Request> req);
   std::vector<std::shared_ptr<Request>> _reqs;
+  // may be changed while serving, applies from the next batch
+  void set_batch_policy(const BatchPolicy &policy);
+  BatchPolicy _policy; // guarded by _mutex
+  // per request: wait = time queued, busy = share of the batch run time
+  static constexpr int kNumLoops = 8;
+  StageMetrics _metrics{"inference", kNumLoops};
+  BatchMetrics _batch_metrics;
   // std::thread _loop;
   std::vector<std::thread> _loops;
   std::mutex _mutex;
@@ -131,7 +168,25 @@ class OnnxEngine {
 public:
   void addModel(const std::string &name, std::unique_ptr<OnnxSession> &&);
   void request(const std::string &name, std::shared_ptr<Request> req) {
-    _sessions[name]->addReq(req);
+    session(name)->addReq(req);
+  }
+
+  void request_async(const std::string &name, std::shared_ptr<Request> req) {
+    session(name)->addReqAsync(req);
+  }
+
+  OnnxSession *session(const std::string &name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _sessions.at(name).get();
+  }
+
+  // e.g. for a metrics scrape; sessions are not removed while it runs
+  void for_each_session(
+      const std::function<void(const std::string &, OnnxSession &)> &fn) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &kv : _sessions) {
+      fn(kv.first, *kv.second);
+    }
   }
 
   static OnnxEngine *get_inst() {
@@ -143,4 +198,6 @@ public:
 
 private:
   OnnxEngine() {}
+  std::mutex _mutex; // models may be added while others are serving
+
 };
@@ -0,0 +1,87 @@
+#include "partial_decoder.h"
+
+#include <algorithm>
+
+// partials are never produced more often than this ...
+static constexpr std::chrono::milliseconds kMinInterval(200);
+// ... nor less often than this
+static constexpr std::chrono::milliseconds kMaxInterval(2000);
+// decoding may take at most 1/kIntervalRatio of the wall clock
+static constexpr int32_t kIntervalRatio = 4;
+
+PartialDecoder::PartialDecoder(SenseVoice *model, int32_t max_frames,
+                               int32_t left_context, int32_t commit_frames)
+    : model_(model),
+      feature_(model->window_size_, model->window_shift_, model->neg_mean_,
+               model->inv_stddev_),
+      max_frames_(max_frames), left_context_(left_context),
+      commit_frames_(std::min(commit_frames, max_frames)) {
+  Reset();
+}
+
+void PartialDecoder::Reset() {
+  feature_.Reset();
+  committed_text_.clear();
+  committed_frames_ = 0;
+  last_id_ = 0;
+  last_decode_ = std::chrono::steady_clock::now();
+  interval_ = kMinInterval;
+}
+
+void PartialDecoder::AcceptWaveform(const float *samples, int32_t n) {
+  feature_.AcceptWaveform(samples, n);
+}
+
+bool PartialDecoder::Ready() const {
+  return std::chrono::steady_clock::now() - last_decode_ >= interval_;
+}
+
+std::string PartialDecoder::Decode() {
+  auto start = std::chrono::steady_clock::now();
+  int32_t n = feature_.NumFramesReady();
+
+  // freeze the oldest frames once the undecided tail gets too long
+  while (n - committed_frames_ > max_frames_) {
+    int32_t end = committed_frames_ + commit_frames_;
+    DecodeRange(std::max(0, committed_frames_ - left_context_),
+                committed_frames_, end, true, &committed_text_);
+    committed_frames_ = end;
+  }
+
+  std::string text = committed_text_;
+  DecodeRange(std::max(0, committed_frames_ - left_context_),
+              committed_frames_, n, false, &text);
+
+  last_decode_ = std::chrono::steady_clock::now();
+  auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(
+      last_decode_ - start);
+  interval_ = std::clamp(cost * kIntervalRatio, kMinInterval, kMaxInterval);
+  return text;
+}
+
+void PartialDecoder::DecodeRange(int32_t begin, int32_t from, int32_t end,
+                                 bool commit, std::string *text) {
+  if (end <= from) {
+    return;
+  }
+  int32_t dim = feature_.FeatureDim();
+  auto ids = model_->infer_ids(feature_.Feats().data() + begin * dim,
+                               end - begin);
+
+  // keep only the ids of frames [from, end), and drop the leading repeat of
+  // the last committed id so that a token spanning the boundary is not
+  // emitted twice
+  int64_t prev = last_id_;
+  std::vector<int64_t> kept;
+  size_t first = SenseVoice::kNumPromptFrames + (from - begin);
+  for (size_t i = first; i < ids.size(); ++i) {
+    if (ids[i] != prev) {
+      kept.push_back(ids[i]);
+    }
+    prev = ids[i];
+  }
+  *text += model_->ids_to_text(kept);
+  if (commit && !ids.empty()) {
+    last_id_ = ids.back();
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "sense_voice.h"
+#include "sense_voice_feature.h"
+
+// Partial results for an utterance that is still being spoken.
+//
+// Features are computed once as audio arrives (OnlineSenseVoiceFeature).
+// Decode() only runs the encoder on a sliding window of at most
+// left_context + max_frames LFR frames: once the undecided tail grows past
+// max_frames, its oldest commit_frames frames are decoded one last time and
+// their text is frozen. The cost of a partial is therefore bounded, no matter
+// how long the utterance gets. Ready() throttles partials to a multiple of
+// the measured decode time so that decoding never starves the audio loop.
+class PartialDecoder {
+public:
+  // One LFR frame is 60ms: by default a window covers at most 2.4s of left
+  // context plus 9.6s of undecided audio.
+  explicit PartialDecoder(SenseVoice *model, int32_t max_frames = 160,
+                          int32_t left_context = 40,
+                          int32_t commit_frames = 80);
+
+  // samples are 16kHz mono, scaled to the int16 range
+  void AcceptWaveform(const float *samples, int32_t n);
+
+  // Whether enough time has passed since the last Decode()
+  bool Ready() const;
+
+  // Text of the whole utterance so far
+  std::string Decode();
+
+  void Reset();
+
+private:
+  // Run the encoder on frames [begin, end) and append the text of frames
+  // [from, end) to text, collapsing repeats across calls through last_id_
+  // when commit is true.
+  void DecodeRange(int32_t begin, int32_t from, int32_t end, bool commit,
+                   std::string *text);
+
+  SenseVoice *model_;
+  OnlineSenseVoiceFeature feature_;
+
+  int32_t max_frames_;
+  int32_t left_context_;
+  int32_t commit_frames_;
+
+  std::string committed_text_;
+  int32_t committed_frames_ = 0;
+  int64_t last_id_ = 0; // last ctc id of the committed frames
+
+  std::chrono::steady_clock::time_point last_decode_;
+  std::chrono::milliseconds interval_;
+};
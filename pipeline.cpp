@@ -0,0 +1,121 @@
+#include "pipeline.h"
+#include "clog.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+Stage::Stage(const std::string &name, int threads, size_t queue_size)
+    : queue_(queue_size), metrics_(name, threads),
+      queue_span_(Tracer::Intern(name + ".queue")) {
+  metrics_.depth = [this] { return queue_.size(); };
+  for (int i = 0; i < threads; ++i) {
+    threads_.emplace_back(&Stage::loop, this);
+  }
+}
+
+Stage::~Stage() {
+  queue_.close();
+  for (auto &th : threads_) {
+    th.join();
+  }
+}
+
+bool Stage::post(std::function<void()> task, uint64_t trace_id) {
+  return queue_.push(
+      {std::move(task), std::chrono::steady_clock::now(), trace_id});
+}
+
+void Stage::loop() {
+  Tracer::get().SetThreadName(metrics_.name);
+  Task task;
+  while (queue_.pop(task)) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t wait = elapsed_ns(task.enqueued, start);
+    Tracer::get().Record(task.trace_id, queue_span_, task.enqueued, start);
+    try {
+      task.fn();
+    } catch (const std::exception &e) {
+      PLOGE << metrics_.name << " task failed: " << e.what();
+    }
+    metrics_.add(elapsed_ns(start), wait);
+    task.fn = nullptr; // release captures before blocking on the next pop
+  }
+}
+
+StageReporter::StageReporter(std::vector<StageMetrics *> stages,
+                             std::chrono::seconds interval,
+                             const TrimMetrics *trim,
+                             const CacheMetrics *cache)
+    : stages_(std::move(stages)), last_(stages_.size()), interval_(interval),
+      trim_(trim), cache_(cache) {
+  th_ = std::thread(&StageReporter::loop, this);
+}
+
+StageReporter::~StageReporter() {
+  {
+    std::lock_guard<std::mutex> lk(mx_);
+    running_ = false;
+  }
+  cv_.notify_all();
+  th_.join();
+}
+
+void StageReporter::loop() {
+  std::unique_lock<std::mutex> lk(mx_);
+  while (!cv_.wait_for(lk, interval_, [this] { return !running_; })) {
+    double wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         interval_)
+                         .count();
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(1) << "pipeline:";
+    for (size_t i = 0; i < stages_.size(); ++i) {
+      auto *m = stages_[i];
+      Snapshot now{m->items.load(std::memory_order_relaxed),
+                   m->busy_ns.load(std::memory_order_relaxed),
+                   m->wait_ns.load(std::memory_order_relaxed)};
+      uint64_t items = now.items - last_[i].items;
+      double util = 100.0 * (now.busy_ns - last_[i].busy_ns) /
+                    (wall_ns * std::max(1, m->threads));
+      double wait_ms =
+          items ? (now.wait_ns - last_[i].wait_ns) / 1e6 / items : 0.0;
+      os << " " << m->name << "[util " << util << "% " << items
+         << " items wait " << wait_ms << "ms";
+      if (m->depth) {
+        os << " depth " << m->depth();
+      }
+      os << "]";
+      last_[i] = now;
+    }
+    if (trim_) {
+      uint64_t now[3] = {trim_->utterances.load(std::memory_order_relaxed),
+                         trim_->input_ms.load(std::memory_order_relaxed),
+                         trim_->kept_ms.load(std::memory_order_relaxed)};
+      double input_s = (now[1] - last_trim_[1]) / 1e3;
+      double kept_s = (now[2] - last_trim_[2]) / 1e3;
+      os << " trim[" << now[0] - last_trim_[0] << " utts " << input_s
+         << "s -> " << kept_s << "s";
+      if (input_s > 0) {
+        os << " (" << 100.0 * kept_s / input_s << "%)";
+      }
+      os << "]";
+      std::copy(now, now + 3, last_trim_);
+    }
+    if (cache_) {
+      uint64_t now[2] = {cache_->hits.load(std::memory_order_relaxed),
+                         cache_->misses.load(std::memory_order_relaxed)};
+      uint64_t hits = now[0] - last_cache_[0];
+      uint64_t lookups = hits + now[1] - last_cache_[1];
+      os << " cache[" << hits << "/" << lookups << " hits";
+      if (lookups) {
+        os << " (" << 100.0 * hits / lookups << "%)";
+      }
+      os << " " << cache_->entries.load(std::memory_order_relaxed)
+         << " entries "
+         << cache_->bytes.load(std::memory_order_relaxed) / 1024.0 << "KB]";
+      std::copy(now, now + 2, last_cache_);
+    }
+    PLOGI << os.str();
+  }
+}
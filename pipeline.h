@@ -0,0 +1,104 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "metrics.h"
+
+// One stage of a processing pipeline: a fixed pool of threads fed by a
+// bounded queue. post() blocks while the queue is full, so a slow stage
+// pushes back on the one before it instead of buffering without limit.
+class Stage {
+public:
+  Stage(const std::string &name, int threads, size_t queue_size);
+  ~Stage();
+
+  // Returns false if the stage is shutting down. With a trace_id, the time
+  // the task waited is traced as "<name>.queue".
+  bool post(std::function<void()> task, uint64_t trace_id = 0);
+
+  StageMetrics &metrics() { return metrics_; }
+
+private:
+  struct Task {
+    std::function<void()> fn;
+    std::chrono::steady_clock::time_point enqueued;
+    uint64_t trace_id = 0;
+  };
+  void loop();
+
+  BoundedQueue<Task> queue_;
+  StageMetrics metrics_;
+  const char *queue_span_;
+  std::vector<std::thread> threads_;
+};
+
+// Caps the number of requests in flight in a stage that has no queue of
+// its own, e.g. the OnnxSession batcher.
+class InflightLimiter {
+public:
+  explicit InflightLimiter(int max) : max_(max) {}
+
+  void acquire() {
+    std::unique_lock<std::mutex> lk(mx_);
+    cv_.wait(lk, [this] { return count_ < max_; });
+    ++count_;
+  }
+
+  void release() {
+    std::lock_guard<std::mutex> lk(mx_);
+    --count_;
+    cv_.notify_one();
+  }
+
+  int count() {
+    std::lock_guard<std::mutex> lk(mx_);
+    return count_;
+  }
+
+private:
+  const int max_;
+  int count_ = 0;
+  std::mutex mx_;
+  std::condition_variable cv_;
+};
+
+// Logs the utilisation of every stage periodically: busy time over
+// threads * wall time, items per second, mean queue wait and queue depth.
+// With trim set, also the audio duration before and after trimming, with
+// cache set the transcript cache hit rate and size.
+class StageReporter {
+public:
+  StageReporter(std::vector<StageMetrics *> stages,
+                std::chrono::seconds interval,
+                const TrimMetrics *trim = nullptr,
+                const CacheMetrics *cache = nullptr);
+  ~StageReporter();
+
+private:
+  void loop();
+
+  struct Snapshot {
+    uint64_t items = 0;
+    uint64_t busy_ns = 0;
+    uint64_t wait_ns = 0;
+  };
+  std::vector<StageMetrics *> stages_;
+  std::vector<Snapshot> last_;
+  std::chrono::seconds interval_;
+  const TrimMetrics *trim_;
+  uint64_t last_trim_[3] = {0, 0, 0};
+  const CacheMetrics *cache_;
+  uint64_t last_cache_[2] = {0, 0};
+
+  bool running_ = true;
+  std::mutex mx_;
+  std::condition_variable cv_;
+  std::thread th_;
+};
@@ -0,0 +1,206 @@
+#include "prefork.h"
+#include "clog.h"
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace {
+
+constexpr int32_t kMaxWorkers = 256;
+
+// pids the signal handler forwards SIGTERM to, 0 for free slots
+volatile pid_t g_pids[kMaxWorkers];
+volatile sig_atomic_t g_stop = 0;
+
+void OnStopSignal(int) {
+  g_stop = 1;
+  for (int32_t i = 0; i < kMaxWorkers; ++i) {
+    if (g_pids[i] > 0) {
+      kill(g_pids[i], SIGTERM);
+    }
+  }
+}
+
+// "0-3,8-11" -> 0 1 2 3 8 9 10 11
+std::vector<int32_t> ParseCpuList(const std::string &list) {
+  std::vector<int32_t> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    auto dash = range.find('-');
+    int32_t first = std::stoi(range.substr(0, dash));
+    int32_t last =
+        dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int32_t cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+} // namespace
+
+std::vector<NumaNode> GetNumaNodes() {
+  std::vector<NumaNode> nodes;
+  const char *root = "/sys/devices/system/node";
+  if (DIR *dir = opendir(root)) {
+    while (dirent *entry = readdir(dir)) {
+      int32_t id = 0;
+      if (std::sscanf(entry->d_name, "node%d", &id) != 1) {
+        continue;
+      }
+      std::ifstream is(std::string(root) + "/" + entry->d_name + "/cpulist");
+      std::string list;
+      if (!std::getline(is, list)) {
+        continue;
+      }
+      NumaNode node;
+      node.id = id;
+      node.cpus = ParseCpuList(list);
+      if (!node.cpus.empty()) {
+        nodes.push_back(std::move(node));
+      }
+    }
+    closedir(dir);
+  }
+  std::sort(nodes.begin(), nodes.end(),
+            [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+
+  if (nodes.empty()) {
+    NumaNode node;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      for (int32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+          node.cpus.push_back(cpu);
+        }
+      }
+    }
+    nodes.push_back(std::move(node));
+  }
+  return nodes;
+}
+
+bool PinToNumaNode(const NumaNode &node) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int32_t cpu : node.cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    PLOGE << "Failed to pin to numa node " << node.id << ": "
+          << std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+int RunPrefork(int32_t num_workers,
+               const std::function<int(int32_t)> &worker) {
+  num_workers = std::min(num_workers, kMaxWorkers);
+  auto nodes = GetNumaNodes();
+  PLOGI << "Prefork: " << num_workers << " workers on " << nodes.size()
+        << " numa nodes";
+
+  struct sigaction sa;
+  std::memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = OnStopSignal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  struct Worker {
+    int32_t index;
+    std::chrono::steady_clock::time_point started;
+  };
+  std::map<pid_t, Worker> workers;
+
+  auto spawn = [&](int32_t index) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      PLOGE << "fork failed: " << std::strerror(errno);
+      return;
+    }
+    if (pid == 0) {
+      signal(SIGINT, SIG_DFL);
+      signal(SIGTERM, SIG_DFL);
+      PinToNumaNode(nodes[index % nodes.size()]);
+      int rc = worker(index);
+      FlushLogs(); // _exit() skips the atexit handlers
+      _exit(rc);
+    }
+    g_pids[index] = pid;
+    if (g_stop) {
+      kill(pid, SIGTERM); // the signal came before the pid was known
+    }
+    workers[pid] = {index, std::chrono::steady_clock::now()};
+    PLOGI << "Worker " << index << " started, pid " << pid << ", numa node "
+          << nodes[index % nodes.size()].id;
+  };
+
+  for (int32_t i = 0; i < num_workers && !g_stop; ++i) {
+    spawn(i);
+  }
+
+  while (!workers.empty()) {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOGE << "waitpid failed: " << std::strerror(errno);
+      break;
+    }
+    auto it = workers.find(pid);
+    if (it == workers.end()) {
+      continue;
+    }
+    Worker w = it->second;
+    workers.erase(it);
+    g_pids[w.index] = 0;
+    if (g_stop) {
+      continue;
+    }
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+      // shut down on purpose, not forked again
+      PLOGI << "Worker " << w.index << " (pid " << pid << ") exited";
+      continue;
+    }
+    if (WIFSIGNALED(status)) {
+      PLOGE << "Worker " << w.index << " (pid " << pid << ") killed by signal "
+            << WTERMSIG(status) << ", restarting";
+    } else {
+      PLOGE << "Worker " << w.index << " (pid " << pid << ") exited with "
+            << WEXITSTATUS(status) << ", restarting";
+    }
+    // a worker that cannot even start would otherwise be forked in a loop
+    if (std::chrono::steady_clock::now() - w.started <
+        std::chrono::seconds(1)) {
+      sleep(1);
+    }
+    if (!g_stop) {
+      spawn(w.index);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A NUMA node and its cpus, as listed in /sys/devices/system/node
+struct NumaNode {
+  int32_t id = 0;
+  std::vector<int32_t> cpus;
+};
+
+// Nodes with at least one cpu. Without NUMA information there is a single
+// node holding every online cpu.
+std::vector<NumaNode> GetNumaNodes();
+
+// Restricts the calling process to the cpus of node. Allocations are first
+// touch, so memory the process touches afterwards stays on the node too.
+bool PinToNumaNode(const NumaNode &node);
+
+// Prefork mode: forks num_workers processes that each run worker(index)
+// pinned to NUMA node index % number of nodes, restarts any worker that
+// dies of a signal or exits with a non-zero status, and returns once all
+// have exited, e.g. after SIGINT or SIGTERM. Everything
+// with threads (the model, the websocket server) must be created inside
+// worker, after the fork.
+int RunPrefork(int32_t num_workers, const std::function<int(int32_t)> &worker);
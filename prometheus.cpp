@@ -0,0 +1,87 @@
+#include "prometheus.h"
+
+#include <iomanip>
+#include <limits>
+
+void PrometheusWriter::Header(const std::string &name, const std::string &help,
+                              const char *type) {
+  if (described_.insert(name).second) {
+    os_ << "# HELP " << name << " " << help << "\n";
+    os_ << "# TYPE " << name << " " << type << "\n";
+  }
+}
+
+void PrometheusWriter::Sample(const std::string &name,
+                              const std::string &labels, double value) {
+  os_ << name;
+  if (!labels.empty()) {
+    os_ << "{" << labels << "}";
+  }
+  os_ << " "
+      << std::setprecision(std::numeric_limits<double>::max_digits10)
+      << value << "\n";
+}
+
+void PrometheusWriter::Sample(const std::string &name,
+                              const std::string &labels, uint64_t value) {
+  os_ << name;
+  if (!labels.empty()) {
+    os_ << "{" << labels << "}";
+  }
+  os_ << " " << value << "\n";
+}
+
+void PrometheusWriter::Counter(const std::string &name,
+                               const std::string &help, double value,
+                               const std::string &labels) {
+  Header(name, help, "counter");
+  Sample(name, labels, value);
+}
+
+void PrometheusWriter::Counter(const std::string &name,
+                               const std::string &help, uint64_t value,
+                               const std::string &labels) {
+  Header(name, help, "counter");
+  Sample(name, labels, value);
+}
+
+void PrometheusWriter::Gauge(const std::string &name, const std::string &help,
+                             double value, const std::string &labels) {
+  Header(name, help, "gauge");
+  Sample(name, labels, value);
+}
+
+void PrometheusWriter::Hist(const std::string &name, const std::string &help,
+                            const Histogram &h, const std::string &labels) {
+  Header(name, help, "histogram");
+  std::string sep = labels.empty() ? "" : labels + ",";
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i <= h.bounds().size(); ++i) {
+    cumulative += h.count(i);
+    std::ostringstream le;
+    if (i < h.bounds().size()) {
+      le << h.bounds()[i];
+    } else {
+      le << "+Inf";
+    }
+    Sample(name + "_bucket", sep + "le=\"" + le.str() + "\"", cumulative);
+  }
+  Sample(name + "_sum", labels, h.sum());
+  Sample(name + "_count", labels, cumulative);
+}
+
+std::string PrometheusWriter::Label(const std::string &key,
+                                    const std::string &value) {
+  std::string out = key + "=\"";
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
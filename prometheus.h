@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "metrics.h"
+
+// Builds a scrape in the Prometheus text exposition format. labels is the
+// inside of the braces, e.g. stage="decode", or empty. Samples of one
+// metric name must be written one after another.
+class PrometheusWriter {
+public:
+  void Counter(const std::string &name, const std::string &help, double value,
+               const std::string &labels = "");
+  void Counter(const std::string &name, const std::string &help,
+               uint64_t value, const std::string &labels = "");
+  void Gauge(const std::string &name, const std::string &help, double value,
+             const std::string &labels = "");
+  void Hist(const std::string &name, const std::string &help,
+            const Histogram &h, const std::string &labels = "");
+
+  std::string str() const { return os_.str(); }
+
+  // key="value" with value escaped
+  static std::string Label(const std::string &key, const std::string &value);
+
+private:
+  void Header(const std::string &name, const std::string &help,
+              const char *type);
+  // counts are written in full, doubles with enough digits to round trip,
+  // so that large counters still change between scrapes
+  void Sample(const std::string &name, const std::string &labels,
+              double value);
+  void Sample(const std::string &name, const std::string &labels,
+              uint64_t value);
+
+  std::ostringstream os_;
+  std::set<std::string> described_;
+};
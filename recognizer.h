@@ -0,0 +1,22 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sense_voice_feature.h"
+
+// A thread-safe speech recognizer that can be shared by many Asr pipelines.
+class Recognizer {
+public:
+  virtual ~Recognizer() = default;
+
+  // wav is 16kHz mono, scaled to the int16 range
+  virtual std::string recog(const std::vector<float> &wav) = 0;
+
+  // Features computed by a stream's own create_feature() extractor while the
+  // audio was arriving, so that only the encoder is left at utterance end.
+  virtual std::string recog_feats(std::vector<float> &&feats) = 0;
+
+  // A per-stream incremental front end matching this model
+  virtual std::unique_ptr<OnlineSenseVoiceFeature> create_feature() const = 0;
+};
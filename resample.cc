@@ -24,12 +24,22 @@
 
 #include "resample.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <tuple>
 #include <type_traits>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define RESAMPLE_X86 1
+#include <immintrin.h>
+#endif
+
 #ifndef M_2PI
 #define M_2PI 6.283185307179586476925286766559005
 #endif
@@ -72,7 +82,10 @@ template <class I> static I Lcm(I m, I n) {
   return gcd * (m / gcd) * (n / gcd);
 }
 
-static float DotProduct(const float *a, const float *b, int32_t n) {
+// Dot products over n weights, n a multiple of
+// LinearResampleFilter::kTapAlignment. The best of AVX-512, AVX2+FMA and
+// plain C++ is picked once at runtime.
+static float DotProductScalar(const float *a, const float *b, int32_t n) {
   float sum = 0;
   for (int32_t i = 0; i != n; ++i) {
     sum += a[i] * b[i];
@@ -80,54 +93,149 @@ static float DotProduct(const float *a, const float *b, int32_t n) {
   return sum;
 }
 
-LinearResample::LinearResample(int32_t samp_rate_in_hz,
-                               int32_t samp_rate_out_hz, float filter_cutoff_hz,
-                               int32_t num_zeros)
-    : samp_rate_in_(samp_rate_in_hz), samp_rate_out_(samp_rate_out_hz),
-      filter_cutoff_(filter_cutoff_hz), num_zeros_(num_zeros) {
+#ifdef RESAMPLE_X86
+__attribute__((target("avx2,fma"))) static float
+DotProductAvx2(const float *a, const float *b, int32_t n) {
+  __m256 sum = _mm256_setzero_ps();
+  for (int32_t i = 0; i != n; i += 8) {
+    sum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_load_ps(b + i), sum);
+  }
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(sum),
+                        _mm256_extractf128_ps(sum, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx512f"))) static float
+DotProductAvx512(const float *a, const float *b, int32_t n) {
+  __m512 sum = _mm512_setzero_ps();
+  int32_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum);
+  }
+  if (i != n) { // 8 left
+    __mmask16 m = 0x00FF;
+    sum = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i),
+                          _mm512_maskz_loadu_ps(m, b + i), sum);
+  }
+  return _mm512_reduce_add_ps(sum);
+}
+#endif
+
+using DotProductFn = float (*)(const float *, const float *, int32_t);
+
+static DotProductFn GetDotProduct() {
+  static const DotProductFn fn = [] {
+#ifdef RESAMPLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return DotProductAvx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return DotProductAvx2;
+    }
+#endif
+    return DotProductScalar;
+  }();
+  return fn;
+}
+
+const char *LinearResample::Isa() {
+  DotProductFn fn = GetDotProduct();
+#ifdef RESAMPLE_X86
+  if (fn == DotProductAvx512) return "avx512";
+  if (fn == DotProductAvx2) return "avx2";
+#endif
+  return "scalar";
+}
+
+LinearResampleFilter::LinearResampleFilter(int32_t samp_rate_in_hz,
+                                           int32_t samp_rate_out_hz,
+                                           float filter_cutoff_hz,
+                                           int32_t num_zeros)
+    : samp_rate_in(samp_rate_in_hz), samp_rate_out(samp_rate_out_hz),
+      filter_cutoff(filter_cutoff_hz), num_zeros(num_zeros) {
   assert(samp_rate_in_hz > 0.0 && samp_rate_out_hz > 0.0 &&
          filter_cutoff_hz > 0.0 && filter_cutoff_hz * 2 <= samp_rate_in_hz &&
          filter_cutoff_hz * 2 <= samp_rate_out_hz && num_zeros > 0);
 
   // base_freq is the frequency of the repeating unit, which is the gcd
   // of the input frequencies.
-  int32_t base_freq = Gcd(samp_rate_in_, samp_rate_out_);
-  input_samples_in_unit_ = samp_rate_in_ / base_freq;
-  output_samples_in_unit_ = samp_rate_out_ / base_freq;
-
-  SetIndexesAndWeights();
-  Reset();
-}
+  int32_t base_freq = Gcd(samp_rate_in, samp_rate_out);
+  input_samples_in_unit = samp_rate_in / base_freq;
+  output_samples_in_unit = samp_rate_out / base_freq;
 
-void LinearResample::SetIndexesAndWeights() {
-  first_index_.resize(output_samples_in_unit_);
-  weights_.resize(output_samples_in_unit_);
+  first_index.resize(output_samples_in_unit);
+  num_taps.resize(output_samples_in_unit);
 
-  double window_width = num_zeros_ / (2.0 * filter_cutoff_);
+  double window_width = num_zeros / (2.0 * filter_cutoff);
 
-  for (int32_t i = 0; i < output_samples_in_unit_; i++) {
-    double output_t = i / static_cast<double>(samp_rate_out_);
+  std::vector<std::vector<float>> rows(output_samples_in_unit);
+  int32_t max_taps = 0;
+  for (int32_t i = 0; i < output_samples_in_unit; i++) {
+    double output_t = i / static_cast<double>(samp_rate_out);
     double min_t = output_t - window_width, max_t = output_t + window_width;
     // we do ceil on the min and floor on the max, because if we did it
     // the other way around we would unnecessarily include indexes just
     // outside the window, with zero coefficients.  It's possible
     // if the arguments to the ceil and floor expressions are integers
-    // (e.g. if filter_cutoff_ has an exact ratio with the sample rates),
+    // (e.g. if filter_cutoff has an exact ratio with the sample rates),
     // that we unnecessarily include something with a zero coefficient,
     // but this is only a slight efficiency issue.
-    int32_t min_input_index = ceil(min_t * samp_rate_in_),
-            max_input_index = floor(max_t * samp_rate_in_),
+    int32_t min_input_index = ceil(min_t * samp_rate_in),
+            max_input_index = floor(max_t * samp_rate_in),
             num_indices = max_input_index - min_input_index + 1;
-    first_index_[i] = min_input_index;
-    weights_[i].resize(num_indices);
+    first_index[i] = min_input_index;
+    num_taps[i] = num_indices;
+    max_taps = std::max(max_taps, num_indices);
+    rows[i].resize(num_indices);
     for (int32_t j = 0; j < num_indices; j++) {
       int32_t input_index = min_input_index + j;
-      double input_t = input_index / static_cast<double>(samp_rate_in_),
+      double input_t = input_index / static_cast<double>(samp_rate_in),
              delta_t = input_t - output_t;
       // sign of delta_t doesn't matter.
-      weights_[i][j] = FilterFunc(delta_t) / samp_rate_in_;
+      rows[i][j] = FilterFunc(delta_t) / samp_rate_in;
     }
   }
+
+  stride = (max_taps + kTapAlignment - 1) / kTapAlignment * kTapAlignment;
+  weights.assign(static_cast<size_t>(output_samples_in_unit) * stride, 0.0f);
+  for (int32_t i = 0; i < output_samples_in_unit; i++) {
+    std::copy(rows[i].begin(), rows[i].end(),
+              weights.begin() + static_cast<size_t>(i) * stride);
+  }
+}
+
+std::shared_ptr<const LinearResampleFilter> LinearResampleFilter::Get(
+    int32_t samp_rate_in_hz, int32_t samp_rate_out_hz, float filter_cutoff_hz,
+    int32_t num_zeros) {
+  using Key = std::tuple<int32_t, int32_t, float, int32_t>;
+  static std::mutex mutex;
+  static std::map<Key, std::shared_ptr<const LinearResampleFilter>> cache;
+
+  // The rates come from clients: an odd one such as 15999 has thousands of
+  // phases, several MB of weights, and a client cycling through them must
+  // not grow the cache without bound. Only the usual rates are kept.
+  auto common = [](int32_t rate) {
+    static const int32_t kRates[] = {8000,  11025, 16000, 22050,
+                                     24000, 32000, 44100, 48000};
+    return std::find(std::begin(kRates), std::end(kRates), rate) !=
+           std::end(kRates);
+  };
+  if (!common(samp_rate_in_hz) || !common(samp_rate_out_hz)) {
+    return std::make_shared<const LinearResampleFilter>(
+        samp_rate_in_hz, samp_rate_out_hz, filter_cutoff_hz, num_zeros);
+  }
+
+  Key key{samp_rate_in_hz, samp_rate_out_hz, filter_cutoff_hz, num_zeros};
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &filter = cache[key];
+  if (!filter) {
+    filter = std::make_shared<const LinearResampleFilter>(
+        samp_rate_in_hz, samp_rate_out_hz, filter_cutoff_hz, num_zeros);
+  }
+  return filter;
 }
 
 /** Here, t is a time in seconds representing an offset from
@@ -135,21 +243,40 @@ void LinearResample::SetIndexesAndWeights() {
     returns the windowed filter function, described
     in the header as h(t) = f(t)g(t), evaluated at t.
 */
-float LinearResample::FilterFunc(float t) const {
+float LinearResampleFilter::FilterFunc(float t) const {
   float window = 0, // raised-cosine (Hanning) window of width
-                    // num_zeros_/2*filter_cutoff_
+                    // num_zeros/2*filter_cutoff
       filter = 0;   // sinc filter function
-  if (std::fabs(t) < num_zeros_ / (2.0 * filter_cutoff_))
-    window = 0.5 * (1 + cos(M_2PI * filter_cutoff_ / num_zeros_ * t));
+  if (std::fabs(t) < num_zeros / (2.0 * filter_cutoff))
+    window = 0.5 * (1 + cos(M_2PI * filter_cutoff / num_zeros * t));
   else
     window = 0.0; // outside support of window function
   if (t != 0)
-    filter = sin(M_2PI * filter_cutoff_ * t) / (M_PI * t);
+    filter = sin(M_2PI * filter_cutoff * t) / (M_PI * t);
   else
-    filter = 2 * filter_cutoff_; // limit of the function at t = 0
+    filter = 2 * filter_cutoff; // limit of the function at t = 0
   return filter * window;
 }
 
+LinearResample::LinearResample(int32_t samp_rate_in_hz,
+                               int32_t samp_rate_out_hz, float filter_cutoff_hz,
+                               int32_t num_zeros)
+    : samp_rate_in_(samp_rate_in_hz), samp_rate_out_(samp_rate_out_hz),
+      filter_cutoff_(filter_cutoff_hz), num_zeros_(num_zeros),
+      filter_(LinearResampleFilter::Get(samp_rate_in_hz, samp_rate_out_hz,
+                                        filter_cutoff_hz, num_zeros)) {
+  Reset();
+}
+
+std::unique_ptr<LinearResample> LinearResample::Create(
+    int32_t samp_rate_in_hz, int32_t samp_rate_out_hz) {
+  float min_freq = std::min(samp_rate_in_hz, samp_rate_out_hz);
+  float lowpass_cutoff = 0.99 * 0.5 * min_freq;
+  int32_t lowpass_filter_width = 6;
+  return std::make_unique<LinearResample>(samp_rate_in_hz, samp_rate_out_hz,
+                                          lowpass_cutoff, lowpass_filter_width);
+}
+
 void LinearResample::Reset() {
   input_sample_offset_ = 0;
   output_sample_offset_ = 0;
@@ -164,46 +291,49 @@ void LinearResample::Resample(const float *input, int32_t input_dim, bool flush,
   assert(tot_output_samp >= output_sample_offset_);
 
   output->resize(tot_output_samp - output_sample_offset_);
+  float *out = output->data();
+
+  const LinearResampleFilter &f = *filter_;
+  DotProductFn dot = GetDotProduct();
 
-  // samp_out is the index into the total output signal, not just the part
-  // of it we are producing here.
-  for (int64_t samp_out = output_sample_offset_; samp_out < tot_output_samp;
-       samp_out++) {
-    int64_t first_samp_in = 0;
-    int32_t samp_out_wrapped = 0;
-    GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
-    const std::vector<float> &weights = weights_[samp_out_wrapped];
-    // first_input_index is the first index into "input" that we have a weight
-    // for.
-    int32_t first_input_index =
-        static_cast<int32_t>(first_samp_in - input_sample_offset_);
-    float this_output = 0;
-    if (first_input_index >= 0 &&
-        first_input_index + static_cast<int32_t>(weights.size()) <= input_dim) {
-      this_output =
-          DotProduct(input + first_input_index, weights.data(), weights.size());
-    } else { // Handle edge cases.
-      this_output = 0.0;
-      for (int32_t i = 0; i < static_cast<int32_t>(weights.size()); i++) {
-        float weight = weights[i];
-        int32_t input_index = first_input_index + i;
-        if (input_index < 0 &&
-            static_cast<int32_t>(input_remainder_.size()) + input_index >= 0) {
-          this_output +=
-              weight * input_remainder_[input_remainder_.size() + input_index];
-        } else if (input_index >= 0 && input_index < input_dim) {
-          this_output += weight * input[input_index];
-        } else if (input_index >= input_dim) {
-          // We're past the end of the input and are adding zero; should only
-          // happen if the user specified flush == true, or else we would not
-          // be trying to output this sample.
-          assert(flush);
-        }
-      }
+  if (f.output_samples_in_unit == 1) {
+    // Integer decimation (e.g. 48k -> 16k): a single phase, every output
+    // sample starts input_samples_in_unit samples after the previous one.
+    const float *w = f.Weights(0);
+    int32_t num_taps = f.num_taps[0];
+    int64_t first = f.first_index[0] +
+                    output_sample_offset_ * f.input_samples_in_unit -
+                    input_sample_offset_;
+    for (int64_t samp_out = output_sample_offset_; samp_out < tot_output_samp;
+         samp_out++, first += f.input_samples_in_unit) {
+      int32_t first_input_index = static_cast<int32_t>(first);
+      bool inside =
+          first_input_index >= 0 && first_input_index + f.stride <= input_dim;
+      *out++ = inside ? dot(input + first_input_index, w, f.stride)
+                      : EdgeOutput(input, input_dim, first_input_index, w,
+                                   num_taps, flush);
+    }
+  } else {
+    // samp_out is the index into the total output signal, not just the part
+    // of it we are producing here.
+    for (int64_t samp_out = output_sample_offset_; samp_out < tot_output_samp;
+         samp_out++) {
+      int64_t first_samp_in = 0;
+      int32_t samp_out_wrapped = 0;
+      GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
+      const float *w = f.Weights(samp_out_wrapped);
+      // first_input_index is the first index into "input" that we have a
+      // weight for.
+      int32_t first_input_index =
+          static_cast<int32_t>(first_samp_in - input_sample_offset_);
+      // The zero padding of the weights is read as well, so the fast path
+      // needs stride valid input samples, not just num_taps.
+      bool inside =
+          first_input_index >= 0 && first_input_index + f.stride <= input_dim;
+      *out++ = inside ? dot(input + first_input_index, w, f.stride)
+                      : EdgeOutput(input, input_dim, first_input_index, w,
+                                   f.num_taps[samp_out_wrapped], flush);
     }
-    int32_t output_index =
-        static_cast<int32_t>(samp_out - output_sample_offset_);
-    (*output)[output_index] = this_output;
   }
 
   if (flush) {
@@ -215,6 +345,30 @@ void LinearResample::Resample(const float *input, int32_t input_dim, bool flush,
   }
 }
 
+float LinearResample::EdgeOutput(const float *input, int32_t input_dim,
+                                 int32_t first_input_index,
+                                 const float *weights, int32_t num_taps,
+                                 bool flush) const {
+  float this_output = 0.0;
+  for (int32_t i = 0; i < num_taps; i++) {
+    float weight = weights[i];
+    int32_t input_index = first_input_index + i;
+    if (input_index < 0 &&
+        static_cast<int32_t>(input_remainder_.size()) + input_index >= 0) {
+      this_output +=
+          weight * input_remainder_[input_remainder_.size() + input_index];
+    } else if (input_index >= 0 && input_index < input_dim) {
+      this_output += weight * input[input_index];
+    } else if (input_index >= input_dim) {
+      // We're past the end of the input and are adding zero; should only
+      // happen if the user specified flush == true, or else we would not
+      // be trying to output this sample.
+      assert(flush);
+    }
+  }
+  return this_output;
+}
+
 int64_t LinearResample::GetNumOutputSamples(int64_t input_num_samp,
                                             bool flush) const {
   // For exact computation, we measure time in "ticks" of 1.0 / tick_freq,
@@ -269,12 +423,12 @@ void LinearResample::GetIndexes(int64_t samp_out, int64_t *first_samp_in,
   // A unit is the smallest nonzero amount of time that is an exact
   // multiple of the input and output sample periods.  The unit index
   // is the answer to "which numbered unit we are in".
-  int64_t unit_index = samp_out / output_samples_in_unit_;
-  // samp_out_wrapped is equal to samp_out % output_samples_in_unit_
-  *samp_out_wrapped =
-      static_cast<int32_t>(samp_out - unit_index * output_samples_in_unit_);
-  *first_samp_in =
-      first_index_[*samp_out_wrapped] + unit_index * input_samples_in_unit_;
+  int64_t unit_index = samp_out / filter_->output_samples_in_unit;
+  // samp_out_wrapped is equal to samp_out % output_samples_in_unit
+  *samp_out_wrapped = static_cast<int32_t>(
+      samp_out - unit_index * filter_->output_samples_in_unit);
+  *first_samp_in = filter_->first_index[*samp_out_wrapped] +
+                   unit_index * filter_->input_samples_in_unit;
 }
 
 void LinearResample::SetRemainder(const float *input, int32_t input_dim) {
@@ -25,10 +25,86 @@
 #define SHERPA_ONNX_CSRC_RESAMPLE_H_
 
 #include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
 #include <vector>
 
 namespace sherpa_onnx {
 
+/// Allocator for SIMD friendly, cache line aligned storage.
+template <typename T, size_t Alignment = 64> struct AlignedAllocator {
+  using value_type = T;
+  template <typename U> struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t n) {
+    size_t bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+    void *p = std::aligned_alloc(Alignment, bytes);
+    if (!p) throw std::bad_alloc();
+    return static_cast<T *>(p);
+  }
+  void deallocate(T *p, size_t) { std::free(p); }
+
+  bool operator==(const AlignedAllocator &) const { return true; }
+  bool operator!=(const AlignedAllocator &) const { return false; }
+};
+
+/// The part of LinearResample that depends only on the rates and the filter:
+/// the windowed sinc weights of one repeating unit of output samples.  It is
+/// immutable once built and shared by all resamplers with the same
+/// parameters, see Get().
+struct LinearResampleFilter {
+  int32_t samp_rate_in;
+  int32_t samp_rate_out;
+  float filter_cutoff;
+  int32_t num_zeros;
+
+  int32_t input_samples_in_unit;   ///< samp_rate_in / Gcd(in, out)
+  int32_t output_samples_in_unit;  ///< samp_rate_out / Gcd(in, out)
+
+  /// The first input-sample index that we sum over, for this output-sample
+  /// index.  May be negative; any truncation at the beginning is handled
+  /// separately.
+  std::vector<int32_t> first_index;
+
+  /// Number of weights of each output-sample index (phase).
+  std::vector<int32_t> num_taps;
+
+  /// Distance between the weights of two phases: the largest num_taps
+  /// rounded up to a multiple of kTapAlignment.
+  int32_t stride;
+  static constexpr int32_t kTapAlignment = 8;
+
+  /// Weights on the input samples of all phases in one aligned block:
+  /// phase i starts at i * stride and is zero padded up to stride, so the
+  /// inner loop always runs over whole SIMD vectors.
+  std::vector<float, AlignedAllocator<float>> weights;
+
+  const float *Weights(int32_t phase) const {
+    return weights.data() + static_cast<size_t>(phase) * stride;
+  }
+
+  /// Returns the filter for these parameters, computing it on first use.
+  /// Filters between common rates (8k to 48k) are cached for the lifetime
+  /// of the process, so creating such a resampler costs no filter design at
+  /// all; other rates get a filter of their own, freed with the resampler.
+  static std::shared_ptr<const LinearResampleFilter> Get(
+      int32_t samp_rate_in_hz, int32_t samp_rate_out_hz,
+      float filter_cutoff_hz, int32_t num_zeros);
+
+  LinearResampleFilter(int32_t samp_rate_in_hz, int32_t samp_rate_out_hz,
+                       float filter_cutoff_hz, int32_t num_zeros);
+
+ private:
+  float FilterFunc(float) const;
+};
+
 /*
    We require that the input and output sampling rate be specified as
    integers, as this is an easy way to specify that their ratio be rational.
@@ -45,6 +121,12 @@ class LinearResample {
   LinearResample(int32_t samp_rate_in_hz, int32_t samp_rate_out_hz,
                  float filter_cutoff_hz, int32_t num_zeros);
 
+  /// The filter used by the server and the ALSA reader to convert any rate
+  /// to samp_rate_out_hz: cutoff just below the lower Nyquist frequency and
+  /// 6 zeros.
+  static std::unique_ptr<LinearResample> Create(int32_t samp_rate_in_hz,
+                                                int32_t samp_rate_out_hz);
+
   /// Calling the function Reset() resets the state of the object prior to
   /// processing a new signal; it is only necessary if you have called
   /// Resample(x, x_size, false, y) for some signal, leading to a remainder of
@@ -73,15 +155,14 @@ class LinearResample {
   void Resample(const float *input, int32_t input_dim, bool flush,
                 std::vector<float> *output);
 
+  /// Name of the dot product kernel Resample() uses, for logs and benchmarks
+  static const char *Isa();
+
   //// Return the input and output sampling rates (for checks, for example)
   int32_t GetInputSamplingRate() const { return samp_rate_in_; }
   int32_t GetOutputSamplingRate() const { return samp_rate_out_; }
 
  private:
-  void SetIndexesAndWeights();
-
-  float FilterFunc(float) const;
-
   /// This function outputs the number of output samples we will output
   /// for a signal with "input_num_samp" input samples.  If flush == true,
   /// we return the largest n such that
@@ -94,13 +175,19 @@ class LinearResample {
 
   /// Given an output-sample index, this function outputs to *first_samp_in the
   /// first input-sample index that we have a weight on (may be negative),
-  /// and to *samp_out_wrapped the index into weights_ where we can get the
+  /// and to *samp_out_wrapped the index into filter_->weights where we can get the
   /// corresponding weights on the input.
   inline void GetIndexes(int64_t samp_out, int64_t *first_samp_in,
                          int32_t *samp_out_wrapped) const;
 
   void SetRemainder(const float *input, int32_t input_dim);
 
+  /// One output sample whose weights reach into input_remainder_ or past
+  /// the end of the input.
+  float EdgeOutput(const float *input, int32_t input_dim,
+                   int32_t first_input_index, const float *weights,
+                   int32_t num_taps, bool flush) const;
+
  private:
   // The following variables are provided by the user.
   int32_t samp_rate_in_;
@@ -108,24 +195,8 @@ class LinearResample {
   float filter_cutoff_;
   int32_t num_zeros_;
 
-  int32_t input_samples_in_unit_;  ///< The number of input samples in the
-                                   ///< smallest repeating unit: num_samp_in_ =
-                                   ///< samp_rate_in_hz / Gcd(samp_rate_in_hz,
-                                   ///< samp_rate_out_hz)
-
-  int32_t output_samples_in_unit_;  ///< The number of output samples in the
-                                    ///< smallest repeating unit: num_samp_out_
-                                    ///< = samp_rate_out_hz /
-                                    ///< Gcd(samp_rate_in_hz, samp_rate_out_hz)
-
-  /// The first input-sample index that we sum over, for this output-sample
-  /// index.  May be negative; any truncation at the beginning is handled
-  /// separately.  This is just for the first few output samples, but we can
-  /// extrapolate the correct input-sample index for arbitrary output samples.
-  std::vector<int32_t> first_index_;
-
-  /// Weights on the input samples, for this output-sample index.
-  std::vector<std::vector<float>> weights_;
+  /// Shared with all other resamplers with the same parameters
+  std::shared_ptr<const LinearResampleFilter> filter_;
 
   // the following variables keep track of where we are in a particular signal,
   // if it is being provided over multiple calls to Resample().
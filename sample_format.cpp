@@ -0,0 +1,199 @@
+#include "sample_format.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SAMPLE_FORMAT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+int16_t MulawToLinear(uint8_t u) {
+  u = ~u;
+  int32_t exponent = (u >> 4) & 0x07;
+  int32_t mantissa = u & 0x0F;
+  int32_t sample = (((mantissa << 3) + 0x84) << exponent) - 0x84;
+  return (u & 0x80) ? -sample : sample;
+}
+
+int16_t AlawToLinear(uint8_t a) {
+  a ^= 0x55;
+  int32_t exponent = (a >> 4) & 0x07;
+  int32_t mantissa = a & 0x0F;
+  int32_t sample = exponent == 0
+                       ? (mantissa << 4) + 8
+                       : ((mantissa << 4) + 0x108) << (exponent - 1);
+  return (a & 0x80) ? sample : -sample;
+}
+
+struct CodecTables {
+  float mulaw[256];
+  float alaw[256];
+
+  CodecTables() {
+    for (int32_t i = 0; i < 256; ++i) {
+      mulaw[i] = MulawToLinear(i);
+      alaw[i] = AlawToLinear(i);
+    }
+  }
+};
+
+const CodecTables &GetCodecTables() {
+  static const CodecTables tables;
+  return tables;
+}
+
+void DecodeTable(const float *table, const uint8_t *in, int32_t n,
+                 float *out) {
+  for (int32_t i = 0; i < n; ++i) {
+    out[i] = table[in[i]];
+  }
+}
+
+void Float32Scalar(const uint8_t *in, int32_t n, float *out) {
+  std::memcpy(out, in, static_cast<size_t>(n) * sizeof(float));
+  for (int32_t i = 0; i < n; ++i) {
+    out[i] *= 32768.0f;
+  }
+}
+
+void Int16Scalar(const uint8_t *in, int32_t n, float *out) {
+  for (int32_t i = 0; i < n; ++i) {
+    int16_t s;
+    std::memcpy(&s, in + 2 * i, sizeof(s));
+    out[i] = s;
+  }
+}
+
+#ifdef SAMPLE_FORMAT_X86
+__attribute__((target("avx2"))) void Float32Avx2(const uint8_t *in, int32_t n,
+                                                 float *out) {
+  const __m256 scale = _mm256_set1_ps(32768.0f);
+  int32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps(reinterpret_cast<const float *>(in) + i);
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(x, scale));
+  }
+  Float32Scalar(in + 4 * i, n - i, out + i);
+}
+
+__attribute__((target("avx2"))) void Int16Avx2(const uint8_t *in, int32_t n,
+                                               float *out) {
+  int32_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 2 * i));
+    __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+    __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1));
+    _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(lo));
+    _mm256_storeu_ps(out + i + 8, _mm256_cvtepi32_ps(hi));
+  }
+  Int16Scalar(in + 2 * i, n - i, out + i);
+}
+
+__attribute__((target("avx512f"))) void
+Float32Avx512(const uint8_t *in, int32_t n, float *out) {
+  const __m512 scale = _mm512_set1_ps(32768.0f);
+  int32_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 x = _mm512_loadu_ps(reinterpret_cast<const float *>(in) + i);
+    _mm512_storeu_ps(out + i, _mm512_mul_ps(x, scale));
+  }
+  Float32Scalar(in + 4 * i, n - i, out + i);
+}
+
+__attribute__((target("avx512f"))) void Int16Avx512(const uint8_t *in,
+                                                    int32_t n, float *out) {
+  int32_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 2 * i));
+    _mm512_storeu_ps(out + i, _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(x)));
+  }
+  Int16Scalar(in + 2 * i, n - i, out + i);
+}
+#endif
+
+using Kernel = void (*)(const uint8_t *, int32_t, float *);
+
+struct Dispatch {
+  Kernel float32 = Float32Scalar;
+  Kernel int16 = Int16Scalar;
+  const char *isa = "scalar";
+
+  Dispatch() {
+#ifdef SAMPLE_FORMAT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      float32 = Float32Avx512;
+      int16 = Int16Avx512;
+      isa = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+      float32 = Float32Avx2;
+      int16 = Int16Avx2;
+      isa = "avx2";
+    }
+#endif
+  }
+};
+
+const Dispatch &GetDispatch() {
+  static const Dispatch dispatch;
+  return dispatch;
+}
+
+} // namespace
+
+bool ParseSampleFormat(uint8_t value, SampleFormat *format) {
+  if (value > static_cast<uint8_t>(SampleFormat::kAlaw)) {
+    return false;
+  }
+  *format = static_cast<SampleFormat>(value);
+  return true;
+}
+
+int32_t BytesPerSample(SampleFormat format) {
+  switch (format) {
+  case SampleFormat::kFloat32:
+    return 4;
+  case SampleFormat::kInt16:
+    return 2;
+  default:
+    return 1;
+  }
+}
+
+const char *SampleFormatName(SampleFormat format) {
+  switch (format) {
+  case SampleFormat::kFloat32:
+    return "float32";
+  case SampleFormat::kInt16:
+    return "int16";
+  case SampleFormat::kMulaw:
+    return "mulaw";
+  case SampleFormat::kAlaw:
+    return "alaw";
+  }
+  return "unknown";
+}
+
+void DecodeSamples(SampleFormat format, const uint8_t *in, int32_t n,
+                   float *out) {
+  switch (format) {
+  case SampleFormat::kFloat32:
+    GetDispatch().float32(in, n, out);
+    break;
+  case SampleFormat::kInt16:
+    GetDispatch().int16(in, n, out);
+    break;
+  case SampleFormat::kMulaw:
+    DecodeTable(GetCodecTables().mulaw, in, n, out);
+    break;
+  case SampleFormat::kAlaw:
+    DecodeTable(GetCodecTables().alaw, in, n, out);
+    break;
+  }
+}
+
+const char *DecodeSamplesIsa() { return GetDispatch().isa; }
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+// Encodings of uploaded audio. The value travels in the top byte of the
+// sample rate field of the websocket header, so 0 keeps the original
+// float32 protocol.
+enum class SampleFormat : uint8_t {
+  kFloat32 = 0, // little endian, in [-1, 1]
+  kInt16 = 1,   // little endian PCM
+  kMulaw = 2,   // G.711 mu-law, 8 bit
+  kAlaw = 3,    // G.711 A-law, 8 bit
+};
+
+// Returns false for values no SampleFormat has
+bool ParseSampleFormat(uint8_t value, SampleFormat *format);
+
+int32_t BytesPerSample(SampleFormat format);
+
+const char *SampleFormatName(SampleFormat format);
+
+// Decodes n samples of the given format to floats in the int16 range, which
+// is what the SenseVoice front end expects. in needs no alignment.
+//
+// float32 and int16 use AVX-512 or AVX2 when the CPU has it, picked once at
+// runtime; the 8 bit codecs go through a 256 entry table.
+void DecodeSamples(SampleFormat format, const uint8_t *in, int32_t n,
+                   float *out);
+
+// Name of the kernel DecodeSamples() dispatches to, for logs and benchmarks
+const char *DecodeSamplesIsa();
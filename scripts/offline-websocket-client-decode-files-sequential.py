@@ -27,6 +27,7 @@ Note: The server is implemented in C++.
 
 import argparse
 import asyncio
+import json
 import logging
 import wave
 from typing import List, Tuple
@@ -65,6 +66,28 @@ def get_args():
         help="Port of the server",
     )
 
+    parser.add_argument(
+        "--sample-format",
+        type=str,
+        default="float32",
+        choices=["float32", "int16"],
+        help="Encoding of the uploaded samples. int16 halves the upload size",
+    )
+
+    parser.add_argument(
+        "--multiplex",
+        action="store_true",
+        help="Send all files at once, each frame tagged with the index of its "
+        "file, and collect the results in the order they complete",
+    )
+
+    parser.add_argument(
+        "--timings",
+        action="store_true",
+        help="Ask the server for the milliseconds each request spent per "
+        "pipeline stage; they are logged with the results",
+    )
+
     parser.add_argument(
         "sound_files",
         type=str,
@@ -104,13 +127,83 @@ def read_wave(wave_filename: str) -> Tuple[np.ndarray, int]:
         return samples_float32, f.getframerate()
 
 
+def encode(samples: np.ndarray, sample_rate: int, sample_format: str) -> bytes:
+    # the top byte of the sample rate field selects the format:
+    # 0 float32, 1 int16, 2 mu-law, 3 A-law
+    if sample_format == "int16":
+        fmt = 1
+        data = (samples * 32768).clip(-32768, 32767).astype("<i2")
+    else:
+        fmt = 0
+        data = samples.astype("<f4")
+    data = data.tobytes()
+
+    buf = (sample_rate | (fmt << 24)).to_bytes(4, byteorder="little")
+    buf += len(data).to_bytes(4, byteorder="little")
+    buf += data
+    return buf
+
+
+async def run_multiplexed(
+    server_addr: str,
+    server_port: int,
+    sound_files: List[str],
+    sample_format: str = "float32",
+    timings: bool = False,
+):
+    async with websockets.connect(
+        f"ws://{server_addr}:{server_port}" + ("/?timings=1" if timings else "")
+    ) as websocket:  # noqa
+        start = time.perf_counter()
+        bufs = []
+        for wave_filename in sound_files:
+            samples, sample_rate = read_wave(wave_filename)
+            bufs.append(encode(samples, sample_rate, sample_format))
+
+        # interleave the files frame by frame; each frame starts with
+        # 0x80000000 | id so the server can tell the uploads apart
+        payload_len = 10240
+        offset = 0
+        while any(offset < len(buf) for buf in bufs):
+            for i, buf in enumerate(bufs):
+                if offset < len(buf):
+                    tag = (0x80000000 | i).to_bytes(4, byteorder="little")
+                    await websocket.send(tag + buf[offset : offset + payload_len])
+            offset += payload_len
+
+        # one {"id", "text"} per file, or per segment plus a final
+        # {"id", "done"} for long files
+        texts = {i: [] for i in range(len(bufs))}
+        pending = set(texts)
+        while pending:
+            msg = json.loads(await websocket.recv())
+            i = msg["id"]
+            if "segment" in msg:
+                texts[i].append(msg["text"])
+                continue
+            if not msg.get("done"):
+                texts[i].append(msg["text"])
+            pending.discard(i)
+            end = time.perf_counter()
+            logging.info(
+                f"Results: {sound_files[i]} {' '.join(texts[i])} "
+                f"{end-start:.3f}s"
+            )
+            if "timings" in msg:
+                logging.info(f"Timings (ms): {msg['timings']}")
+
+        await websocket.send("Done")
+
+
 async def run(
     server_addr: str,
     server_port: int,
     sound_files: List[str],
+    sample_format: str = "float32",
+    timings: bool = False,
 ):
     async with websockets.connect(
-        f"ws://{server_addr}:{server_port}"
+        f"ws://{server_addr}:{server_port}" + ("/?timings=1" if timings else "")
     ) as websocket:  # noqa
         for wave_filename in sound_files:
             reqId = str(uuid.uuid4())
@@ -120,9 +213,7 @@ async def run(
             assert samples.dtype == np.float32, samples.dtype
             assert samples.ndim == 1, samples.dim
 
-            buf = sample_rate.to_bytes(4, byteorder="little")  # 4 bytes
-            buf += (samples.size * 4).to_bytes(4, byteorder="little")
-            buf += samples.tobytes()
+            buf = encode(samples, sample_rate, sample_format)
 
             payload_len = 10240
             while len(buf) > payload_len:
@@ -134,6 +225,26 @@ async def run(
 
             start = time.perf_counter()
             decoding_results = await websocket.recv()
+            if decoding_results.startswith("{"):
+                # long files are cut by the server's vad: one json message
+                # per segment, in order, then {"done": true, ...}; with
+                # --timings a whole file is {"text", "timings"}
+                texts = []
+                while True:
+                    msg = json.loads(decoding_results)
+                    if msg.get("done") or "segment" not in msg:
+                        if "text" in msg:
+                            texts.append(msg["text"])
+                        if "timings" in msg:
+                            logging.info(f"{reqId} Timings (ms): {msg['timings']}")
+                        break
+                    logging.info(
+                        f"{reqId} [{msg['start']:.2f}-{msg['end']:.2f}] "
+                        f"{msg['text']}"
+                    )
+                    texts.append(msg["text"])
+                    decoding_results = await websocket.recv()
+                decoding_results = " ".join(texts)
             end = time.perf_counter()
             logging.info(f"Results: {reqId} {wave_filename} {decoding_results} {end-start:.3f}s")
 
@@ -149,10 +260,12 @@ async def main():
     server_port = args.server_port
     sound_files = args.sound_files
 
-    await run(
+    await (run_multiplexed if args.multiplex else run)(
         server_addr=server_addr,
         server_port=server_port,
         sound_files=sound_files,
+        sample_format=args.sample_format,
+        timings=args.timings,
     )
 
 
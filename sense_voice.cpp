@@ -11,11 +11,6 @@
 #include <sstream>
 #include <stdexcept>
 
-#include "kaldi-native-fbank/csrc/feature-fbank.h"
-#include "kaldi-native-fbank/csrc/feature-window.h"
-#include "kaldi-native-fbank/csrc/mel-computations.h"
-#include "kaldi-native-fbank/csrc/online-feature.h"
-
 // for time cost
 #include "util.h"
 
@@ -130,60 +125,31 @@ void SenseVoice::setupIO() {
 std::string SenseVoice::recog(const std::vector<float> &data) {
   // Timer cost("AsrCost");
   //  extract fbank
-  knf::FbankOptions opts;
-  opts.frame_opts.dither = 0;
-  opts.frame_opts.snip_edges = false;
-  opts.frame_opts.window_type = "hamming";
-  opts.frame_opts.samp_freq = 16000;
-  opts.mel_opts.num_bins = 80;
-
-  knf::OnlineFbank fbank(opts);
-  fbank.AcceptWaveform(16000, data.data(), data.size());
-  fbank.InputFinished();
-
-  int32_t n = fbank.NumFramesReady();
-#if 0
-        for (int32_t i = 0; i != n; ++i)
-        {
-          const float *frame = fbank.GetFrame(i);
-          for (int32_t k = 0; k != opts.mel_opts.num_bins; ++k)
-          {
-            os << frame[k] << ", ";
-          }
-          os << "\n";
-        }
-
-        std::cout << os.str() << "\n";
-#endif
-  std::vector<float> feats;
-
-  for (int i = 0; i + window_size_ <= n; i += window_shift_) {
-    for (int k = i * 80; k < (i + window_size_) * 80; k++) {
-      double value = fbank.GetFrame(k / 80)[k % 80];
-      feats.push_back((value + neg_mean_[k % 560]) * inv_stddev_[k % 560]);
-    }
-  }
+  auto feature = create_feature();
+  feature->AcceptWaveform(data.data(), data.size());
+  feature->InputFinished();
+  return recog_feats(std::move(feature->Feats()));
+}
 
-#if 0
-        std::ostringstream os;
-        os << std::fixed << std::setprecision(5);
-
-        for (int32_t i = 0; i != feats.size(); ++i) {
-          {
-            os << feats[i]; 
-          }
-          if (( i + 1) % 560 == 0 ) {
-            os << "\n";
-          } else {
-            os << " ";
-          }
-        }
-#endif
+std::string SenseVoice::recog_feats(std::vector<float> &&feats) {
   auto asr = infer(feats);
   return asr;
 }
 
+std::unique_ptr<OnlineSenseVoiceFeature> SenseVoice::create_feature() const {
+  return std::make_unique<OnlineSenseVoiceFeature>(window_size_, window_shift_,
+                                                   neg_mean_, inv_stddev_);
+}
+
 std::string SenseVoice::infer(const std::vector<float> &fbank) {
+  return ids_to_text(infer_ids(fbank.data(), fbank.size() / 560));
+}
+
+std::vector<int64_t> SenseVoice::infer_ids(const float *fbank,
+                                           int32_t num_frames) {
+  if (num_frames <= 0) {
+    return {};
+  }
   Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(
       OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
 
@@ -199,23 +165,23 @@ std::string SenseVoice::infer(const std::vector<float> &fbank) {
   // x
   std::vector<int64_t> dims;
   dims.push_back(1);
-  dims.push_back(fbank.size() / 560);
+  dims.push_back(num_frames);
   dims.push_back(560);
 
   auto x_ort = Ort::Value::CreateTensor<float>(
-      memory_info, const_cast<float *>(fbank.data()), fbank.size(), dims.data(),
+      memory_info, const_cast<float *>(fbank), num_frames * 560, dims.data(),
       dims.size());
 
   // x_lenght
   dims.clear();
   dims.push_back(1);
-  int32_t x_length = fbank.size() / 560;
+  int32_t x_length = num_frames;
   auto x_length_ort = Ort::Value::CreateTensor<int32_t>(
       memory_info, &x_length, 1, dims.data(), dims.size());
 
   dims.clear();
   dims.push_back(1);
-  int32_t lang = lang_id_["lang_zh"];
+  int32_t lang = lang_id_.at("lang_zh");
   auto lang_ort = Ort::Value::CreateTensor<int32_t>(memory_info, &lang, 1,
                                                     dims.data(), dims.size());
 
@@ -272,11 +238,19 @@ std::string SenseVoice::infer(const std::vector<float> &fbank) {
         row_start, std::max_element(row_start, row_start + last_dim));
   }
 
-  std::vector<int64_t> final = unique_consecutive<int64_t>(result);
+  return result;
+}
+
+std::string SenseVoice::ids_to_text(const std::vector<int64_t> &ids) {
+  std::vector<int64_t> final = unique_consecutive<int64_t>(ids);
   std::string asr;
   for (const auto f : final) {
     if (f > 0 and f < 24884) {
-      asr += tokens_[std::to_string(f)];
+      // may be shared between threads, never insert into tokens_ here
+      auto it = tokens_.find(std::to_string(f));
+      if (it != tokens_.end()) {
+        asr += it->second;
+      }
     }
   }
   return asr;
@@ -4,17 +4,29 @@
 #include <map>
 #include <memory>
 #include <onnxruntime_cxx_api.h>
+#include "recognizer.h"
 #include <string>
 #include <vector>
 
-class SenseVoice {
+class SenseVoice : public Recognizer {
 public:
   SenseVoice(const std::string &model_path, const std::string &token_path);
   ~SenseVoice();
 
-  std::string recog(const std::vector<float> &wav);
+  std::string recog(const std::vector<float> &wav) override;
+  std::string recog_feats(std::vector<float> &&feats) override;
+  std::unique_ptr<OnlineSenseVoiceFeature> create_feature() const override;
 
   std::string infer(const std::vector<float> &feat);
+
+  // Frame level argmax of the ctc output for (num_frames, 560) features. The
+  // first kNumPromptFrames ids are the language/emotion/event/itn prompts,
+  // id i + kNumPromptFrames belongs to input frame i.
+  std::vector<int64_t> infer_ids(const float *feat, int32_t num_frames);
+  static constexpr int32_t kNumPromptFrames = 4;
+
+  // ctc collapse, drop blank and special tokens
+  std::string ids_to_text(const std::vector<int64_t> &ids);
   int32_t window_size_;
   int32_t window_shift_;
   int32_t with_itn_;
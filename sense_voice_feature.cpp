@@ -0,0 +1,137 @@
+#include "sense_voice_feature.h"
+#include "fbank_computer.h"
+#include "lfr_cmvn.h"
+
+#include <algorithm>
+
+// consumed samples/frames are dropped in batches of at least this many
+static constexpr int64_t kMinTrim = 4096;
+
+OnlineSenseVoiceFeature::OnlineSenseVoiceFeature(
+    int32_t window_size, int32_t window_shift,
+    const std::vector<float> &neg_mean, const std::vector<float> &inv_stddev)
+    : window_size_(window_size), window_shift_(window_shift),
+      scale_(inv_stddev), bias_(neg_mean.size()) {
+  for (size_t k = 0; k < bias_.size(); ++k) {
+    bias_[k] = neg_mean[k] * inv_stddev[k];
+  }
+  Reset();
+}
+
+OnlineSenseVoiceFeature::~OnlineSenseVoiceFeature() {}
+
+void OnlineSenseVoiceFeature::Reset() {
+  wave_.clear();
+  external_ = nullptr;
+  wave_offset_ = 0;
+  num_samples_ = 0;
+  finished_ = false;
+  fbank_.clear();
+  fbank_offset_ = 0;
+  num_fbank_ = 0;
+  next_lfr_ = 0;
+  feats_.clear();
+}
+
+void OnlineSenseVoiceFeature::AcceptWaveform(const float *samples,
+                                             int32_t n) {
+  wave_.insert(wave_.end(), samples, samples + n);
+  num_samples_ += n;
+  ComputeFbank();
+  ComputeLfr();
+}
+
+void OnlineSenseVoiceFeature::InputFinished() {
+  finished_ = true;
+  ComputeFbank();
+  ComputeLfr();
+}
+
+void OnlineSenseVoiceFeature::AcceptBuffered(const float *utterance,
+                                             int64_t num_samples) {
+  external_ = utterance;
+  num_samples_ = num_samples;
+  ComputeFbank();
+  ComputeLfr();
+}
+
+void OnlineSenseVoiceFeature::AcceptWaveformAndFinish(const float *samples,
+                                                      int32_t n) {
+  if (!external_ && num_samples_ > 0) {
+    AcceptWaveform(samples, n);
+  } else {
+    AcceptBuffered(samples, n);
+  }
+  InputFinished();
+}
+
+void OnlineSenseVoiceFeature::ComputeFbank() {
+  if (external_) {
+    ComputeFbank(external_); // wave_offset_ stays 0
+    return;
+  }
+  ComputeFbank(wave_.data());
+
+  // Samples before the next frame are no longer needed, not even for the
+  // reflection at the end of the signal, which never reaches further back
+  // than the start of the last frame.
+  int64_t keep = std::max<int64_t>(0, FbankComputer::FirstSample(num_fbank_));
+  if (keep - wave_offset_ >= kMinTrim) {
+    wave_.erase(wave_.begin(), wave_.begin() + (keep - wave_offset_));
+    wave_offset_ = keep;
+  }
+}
+
+void OnlineSenseVoiceFeature::ComputeFbank(const float *wave) {
+  constexpr int32_t kDim = FbankComputer::kNumBins;
+  int32_t ready = finished_ ? FbankComputer::NumFrames(num_samples_)
+                            : FbankComputer::NumFramesReady(num_samples_);
+  if (ready > num_fbank_) {
+    size_t offset = fbank_.size();
+    fbank_.resize(offset + static_cast<size_t>(ready - num_fbank_) * kDim);
+
+    FbankComputer::Job job;
+    job.wave = wave;
+    job.offset = wave_offset_;
+    job.num_samples = num_samples_;
+    job.first_frame = num_fbank_;
+    job.num_frames = ready - num_fbank_;
+    job.out = fbank_.data() + offset;
+    FbankComputer::get().Compute(&job, 1);
+    num_fbank_ = ready;
+  }
+}
+
+void OnlineSenseVoiceFeature::ComputeLfr() {
+  constexpr int32_t kDim = FbankComputer::kNumBins;
+  int32_t n = num_fbank_;
+  if (next_lfr_ + window_size_ > n) {
+    return;
+  }
+  int32_t num_new = (n - window_size_ - next_lfr_) / window_shift_ + 1;
+  int32_t dim = FeatureDim();
+  size_t offset = feats_.size();
+  feats_.resize(offset + static_cast<size_t>(num_new) * dim);
+  float *out = feats_.data() + offset;
+
+  const float *frames[16];
+  std::vector<const float *> frames_heap;
+  const float **window = frames;
+  if (window_size_ > 16) {
+    frames_heap.resize(window_size_);
+    window = frames_heap.data();
+  }
+  for (int32_t i = 0; i < num_new; ++i, next_lfr_ += window_shift_) {
+    for (int32_t w = 0; w < window_size_; ++w) {
+      window[w] = fbank_.data() + (next_lfr_ + w - fbank_offset_) * kDim;
+    }
+    LfrCmvn(window, window_size_, kDim, scale_.data(), bias_.data(), out);
+    out += dim;
+  }
+
+  if ((next_lfr_ - fbank_offset_) * kDim >= kMinTrim) {
+    int32_t drop = std::min(next_lfr_, num_fbank_) - fbank_offset_;
+    fbank_.erase(fbank_.begin(), fbank_.begin() + drop * kDim);
+    fbank_offset_ += drop;
+  }
+}
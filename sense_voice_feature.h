@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Incremental SenseVoice front end: 80-dim fbank, LFR stacking and CMVN.
+//
+// Audio can be fed in pieces as it arrives; every LFR frame (window_size
+// fbank frames, 560 dims for 7x80) is computed exactly once, as soon as all
+// of its fbank frames are ready. The result is identical to running the
+// whole utterance through SenseVoice::recog's front end in one go.
+class OnlineSenseVoiceFeature {
+public:
+  OnlineSenseVoiceFeature(int32_t window_size, int32_t window_shift,
+                          const std::vector<float> &neg_mean,
+                          const std::vector<float> &inv_stddev);
+  ~OnlineSenseVoiceFeature();
+
+  // samples are 16kHz mono, scaled to the int16 range
+  void AcceptWaveform(const float *samples, int32_t n);
+
+  // No more audio, flush the last fbank frames.
+  void InputFinished();
+
+  // For callers that keep the whole utterance in one buffer themselves:
+  // utterance[0, num_samples) is all audio so far, and the buffer stays
+  // valid and unmodified up to InputFinished(). Frames are computed
+  // straight from it, nothing is copied. Do not mix with AcceptWaveform().
+  void AcceptBuffered(const float *utterance, int64_t num_samples);
+
+  // AcceptBuffered() + InputFinished() for a whole utterance.
+  void AcceptWaveformAndFinish(const float *samples, int32_t n);
+
+  // Drop all audio and features, ready for the next utterance.
+  void Reset();
+
+  int32_t FeatureDim() const { return 80 * window_size_; }
+
+  // fbank frames (10ms) between two LFR frames
+  int32_t WindowShift() const { return window_shift_; }
+
+  // Number of LFR frames computed so far
+  int32_t NumFramesReady() const {
+    return static_cast<int32_t>(feats_.size() / FeatureDim());
+  }
+
+  // (NumFramesReady(), FeatureDim()) row major
+  const std::vector<float> &Feats() const { return feats_; }
+  std::vector<float> &Feats() { return feats_; }
+
+private:
+  void ComputeFbank();
+  void ComputeFbank(const float *wave);
+  void ComputeLfr();
+
+  int32_t window_size_;
+  int32_t window_shift_;
+  std::vector<float> scale_; // inv_stddev
+  std::vector<float> bias_;  // neg_mean * inv_stddev
+
+  // samples [wave_offset_, num_samples_) not yet consumed by fbank frames
+  std::vector<float> wave_;
+  const float *external_ = nullptr; // set by AcceptBuffered(), replaces wave_
+  int64_t wave_offset_ = 0;
+  int64_t num_samples_ = 0;
+  bool finished_ = false;
+
+  // fbank frames [fbank_offset_, num_fbank_) not yet consumed by lfr frames
+  std::vector<float> fbank_;
+  int32_t fbank_offset_ = 0;
+  int32_t num_fbank_ = 0;
+
+  int32_t next_lfr_ = 0; // index of the first fbank frame of the next frame
+  std::vector<float> feats_;
+};
@@ -0,0 +1,46 @@
+#include "silence_trimmer.h"
+
+#include <algorithm>
+#include <cmath>
+
+SilenceTrimmer::SilenceTrimmer(float pad_ms, float range_db, float floor_db)
+    : pad_frames_(static_cast<int32_t>(pad_ms / 10)), range_db_(range_db),
+      floor_db_(floor_db) {}
+
+void SilenceTrimmer::AcceptWaveform(const float *samples, int32_t n) {
+  for (int32_t i = 0; i < n; ++i) {
+    sum_ += samples[i] * samples[i];
+    if (++num_ == kHop) {
+      energy_db_.push_back(10 * std::log10(sum_ / kHop + 1e-10));
+      sum_ = 0;
+      num_ = 0;
+    }
+  }
+}
+
+std::pair<int32_t, int32_t> SilenceTrimmer::Range(int32_t num_frames,
+                                                  int32_t window_shift) const {
+  if (energy_db_.empty() || num_frames <= 0) {
+    return {0, std::max(num_frames, 0)};
+  }
+  float peak = *std::max_element(energy_db_.begin(), energy_db_.end());
+  float gate = std::max(peak - range_db_, floor_db_);
+  int32_t first = -1, last = -1;
+  for (int32_t i = 0; i < static_cast<int32_t>(energy_db_.size()); ++i) {
+    if (energy_db_[i] >= gate) {
+      if (first < 0) {
+        first = i;
+      }
+      last = i;
+    }
+  }
+  if (first < 0) {
+    return {0, num_frames};
+  }
+
+  // hop i is roughly fbank frame i, LFR frame k starts at fbank frame
+  // k * window_shift
+  int32_t begin = std::max(0, first - pad_frames_) / window_shift;
+  int32_t end = (last + pad_frames_) / window_shift + 1;
+  return {std::min(begin, num_frames - 1), std::min(end, num_frames)};
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Energy gate that finds where speech starts and ends in an utterance, so
+// the silent lead-in and tail can be cut from its features before the
+// encoder sees them.
+//
+// Audio is fed as it arrives; the mean square energy of every 10ms is kept
+// (100 floats per second). The gate is decided once the utterance is
+// complete: frames within range_db of the loudest one, and above floor_db,
+// count as speech.
+class SilenceTrimmer {
+public:
+  SilenceTrimmer(float pad_ms, float range_db, float floor_db);
+
+  // samples are 16kHz mono, scaled to the int16 range
+  void AcceptWaveform(const float *samples, int32_t n);
+
+  // Range [first, last) of the LFR frames (window_shift fbank frames apart)
+  // to keep, out of num_frames. Everything if no frame passes the gate.
+  std::pair<int32_t, int32_t> Range(int32_t num_frames,
+                                    int32_t window_shift) const;
+
+private:
+  static constexpr int32_t kHop = 160; // one fbank frame shift
+
+  int32_t pad_frames_;
+  float range_db_;
+  float floor_db_;
+
+  std::vector<float> energy_db_; // per kHop samples
+  double sum_ = 0;               // of the current hop
+  int32_t num_ = 0;
+};
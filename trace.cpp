@@ -0,0 +1,151 @@
+#include "trace.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include "config.h"
+
+namespace {
+
+std::string Quote(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out + "\"";
+}
+
+} // namespace
+
+Tracer &Tracer::get() {
+  static Tracer inst;
+  return inst;
+}
+
+Tracer::Tracer()
+    : capacity_(std::max(0, CONFIG::trace_spans_per_thread)),
+      epoch_(Clock::now()) {}
+
+const char *Tracer::Intern(const std::string &name) {
+  static std::mutex mx;
+  static std::set<std::string> names; // nodes do not move
+  std::lock_guard<std::mutex> lock(mx);
+  return names.insert(name).first->c_str();
+}
+
+Tracer::Ring &Tracer::local() {
+  thread_local Ring *ring = nullptr;
+  if (!ring) {
+    auto r = std::make_unique<Ring>();
+    r->spans.resize(capacity_);
+    std::lock_guard<std::mutex> lock(mx_);
+    r->tid = static_cast<int32_t>(rings_.size()) + 1;
+    ring = r.get();
+    rings_.push_back(std::move(r));
+  }
+  return *ring;
+}
+
+void Tracer::Record(uint64_t request, const char *name,
+                    Clock::time_point begin, Clock::time_point end) {
+  if (request == 0 || capacity_ == 0) {
+    return;
+  }
+  Ring &ring = local();
+  std::lock_guard<std::mutex> lock(ring.mx);
+  ring.spans[ring.head++ % capacity_] = {request, name, begin, end};
+}
+
+void Tracer::SetThreadName(const std::string &name) {
+  if (capacity_ == 0) {
+    return;
+  }
+  Ring &ring = local();
+  std::lock_guard<std::mutex> lock(ring.mx);
+  ring.name = name;
+}
+
+std::string Tracer::ChromeJson(uint64_t request) {
+  std::vector<Ring *> rings;
+  {
+    std::lock_guard<std::mutex> lock(mx_);
+    for (auto &r : rings_) {
+      rings.push_back(r.get());
+    }
+  }
+  auto us = [this](Clock::time_point t) {
+    return std::chrono::duration<double, std::micro>(t - epoch_).count();
+  };
+  int pid = getpid();
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+  bool first = true;
+  auto sep = [&os, &first]() {
+    os << (first ? "\n" : ",\n");
+    first = false;
+  };
+  for (auto *ring : rings) {
+    std::lock_guard<std::mutex> lock(ring->mx);
+    if (!ring->name.empty()) {
+      sep();
+      os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+         << ",\"tid\":" << ring->tid
+         << ",\"args\":{\"name\":" << Quote(ring->name) << "}}";
+    }
+    uint64_t begin = ring->head > capacity_ ? ring->head - capacity_ : 0;
+    for (uint64_t i = begin; i < ring->head; ++i) {
+      const Span &s = ring->spans[i % capacity_];
+      if (request != 0 && s.request != request) {
+        continue;
+      }
+      sep();
+      os << "{\"name\":" << Quote(s.name)
+         << ",\"cat\":\"asr\",\"ph\":\"X\",\"ts\":" << us(s.begin)
+         << ",\"dur\":" << us(s.end) - us(s.begin) << ",\"pid\":" << pid
+         << ",\"tid\":" << ring->tid << ",\"args\":{\"request\":" << s.request
+         << "}}";
+    }
+  }
+  os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return os.str();
+}
+
+std::map<std::string, double> Tracer::Timings(uint64_t request,
+                                              Clock::time_point since) {
+  std::map<std::string, double> timings;
+  if (request == 0 || capacity_ == 0) {
+    return timings;
+  }
+  std::vector<Ring *> rings;
+  {
+    std::lock_guard<std::mutex> lock(mx_);
+    for (auto &r : rings_) {
+      rings.push_back(r.get());
+    }
+  }
+  for (auto *ring : rings) {
+    std::lock_guard<std::mutex> lock(ring->mx);
+    uint64_t begin = ring->head > capacity_ ? ring->head - capacity_ : 0;
+    // newest first; a thread records its spans about in the order they
+    // end, so stop at the first one that ended before the request began
+    for (uint64_t i = ring->head; i > begin; --i) {
+      const Span &s = ring->spans[(i - 1) % capacity_];
+      if (s.end < since) {
+        break;
+      }
+      if (s.request == request) {
+        timings[s.name] +=
+            std::chrono::duration<double, std::milli>(s.end - s.begin)
+                .count();
+      }
+    }
+  }
+  return timings;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Spans of individual requests through the pipeline, for finding out where
+// one slow request spent its time. Every thread records into a ring of its
+// own (CONFIG::trace_spans_per_thread spans, oldest overwritten); the rings
+// are only read on demand, as Chrome/Perfetto trace JSON or as the summed
+// stage timings of one request.
+//
+// Request id 0 means "not traced", so code shared with callers that never
+// assign ids can record unconditionally.
+class Tracer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static Tracer &get();
+
+  uint64_t NewId() { return next_id_.fetch_add(1, std::memory_order_relaxed); }
+  bool enabled() const { return capacity_ > 0; }
+
+  // name must outlive the tracer: a literal, or Intern()ed
+  void Record(uint64_t request, const char *name, Clock::time_point begin,
+              Clock::time_point end = Clock::now());
+
+  // A stable copy of name, for span names built at run time
+  static const char *Intern(const std::string &name);
+
+  // Shown as the name of the calling thread's track in the trace viewer
+  void SetThreadName(const std::string &name);
+
+  // Every span still in the rings, or only those of request if it is not 0
+  std::string ChromeJson(uint64_t request = 0);
+
+  // Milliseconds per span name of request, summed over the spans that
+  // ended after since (segments of one upload add up)
+  std::map<std::string, double> Timings(uint64_t request,
+                                        Clock::time_point since);
+
+private:
+  Tracer();
+
+  struct Span {
+    uint64_t request;
+    const char *name;
+    Clock::time_point begin;
+    Clock::time_point end;
+  };
+  // Written by its own thread only; the lock is there for the readers and
+  // is uncontended otherwise.
+  struct Ring {
+    std::mutex mx;
+    std::vector<Span> spans;
+    uint64_t head = 0; // spans ever written
+    int32_t tid = 0;
+    std::string name;
+  };
+  Ring &local();
+
+  const size_t capacity_;
+  const Clock::time_point epoch_;
+  std::atomic<uint64_t> next_id_{1};
+  std::mutex mx_; // guards rings_
+  std::vector<std::unique_ptr<Ring>> rings_; // never freed, threads may exit
+};
+
+// Records a span of request from construction to destruction, like Timer
+// does for the log
+class TraceSpan {
+public:
+  TraceSpan(uint64_t request, const char *name)
+      : request_(request), name_(name), start_(Tracer::Clock::now()) {}
+  ~TraceSpan() { Tracer::get().Record(request_, name_, start_); }
+
+private:
+  uint64_t request_;
+  const char *name_;
+  Tracer::Clock::time_point start_;
+};
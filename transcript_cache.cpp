@@ -0,0 +1,131 @@
+#include "transcript_cache.h"
+
+#include <cstring>
+#include <random>
+
+namespace {
+
+inline uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline void SipRound(uint64_t v[4]) {
+  v[0] += v[1];
+  v[1] = Rotl(v[1], 13) ^ v[0];
+  v[0] = Rotl(v[0], 32);
+  v[2] += v[3];
+  v[3] = Rotl(v[3], 16) ^ v[2];
+  v[0] += v[3];
+  v[3] = Rotl(v[3], 21) ^ v[0];
+  v[2] += v[1];
+  v[1] = Rotl(v[1], 17) ^ v[2];
+  v[2] = Rotl(v[2], 32);
+}
+
+inline void Compress(uint64_t v[4], uint64_t m) {
+  v[3] ^= m;
+  SipRound(v);
+  SipRound(v);
+  v[0] ^= m;
+}
+
+// two samples per 64-bit word, the earlier one in the low half
+inline uint64_t Bits(const float *sample) {
+  uint32_t bits;
+  std::memcpy(&bits, sample, 4);
+  return bits;
+}
+
+struct SipKey {
+  uint64_t k0, k1;
+};
+
+const SipKey &Key() {
+  static const SipKey key = [] {
+    std::random_device rd;
+    auto draw = [&rd] {
+      return (static_cast<uint64_t>(rd()) << 32) | rd();
+    };
+    SipKey k;
+    k.k0 = draw();
+    k.k1 = draw();
+    return k;
+  }();
+  return key;
+}
+
+} // namespace
+
+SampleHasher::SampleHasher() {
+  const SipKey &key = Key();
+  v_[0] = key.k0 ^ 0x736f6d6570736575ull;
+  v_[1] = key.k1 ^ 0x646f72616e646f6dull;
+  v_[2] = key.k0 ^ 0x6c7967656e657261ull;
+  v_[3] = key.k1 ^ 0x7465646279746573ull;
+}
+
+void SampleHasher::Update(const float *samples, int64_t n) {
+  int64_t i = 0;
+  // sample k always lands in word k / 2, wherever the pieces were cut
+  if (n > 0 && num_samples_ % 2 != 0) {
+    Compress(v_, pending_ | Bits(samples) << 32);
+    i = 1;
+  }
+  for (; i + 2 <= n; i += 2) {
+    Compress(v_, Bits(samples + i) | Bits(samples + i + 1) << 32);
+  }
+  if (i < n) {
+    pending_ = Bits(samples + i);
+  }
+  num_samples_ += n;
+}
+
+uint64_t SampleHasher::Digest() const {
+  uint64_t v[4] = {v_[0], v_[1], v_[2], v_[3]};
+  // the last word carries the leftover sample and the length in bytes
+  uint64_t last = static_cast<uint64_t>(num_samples_ * 4) << 56;
+  if (num_samples_ % 2 != 0) {
+    last |= pending_;
+  }
+  Compress(v, last);
+  v[2] ^= 0xff;
+  for (int32_t k = 0; k < 4; ++k) {
+    SipRound(v);
+  }
+  return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+bool TranscriptCache::Get(const Key &key, std::string *text) {
+  std::lock_guard<std::mutex> lock(mx_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    metrics_.misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  *text = it->second->second;
+  metrics_.hits.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void TranscriptCache::Put(const Key &key, const std::string &text) {
+  std::lock_guard<std::mutex> lock(mx_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    // a concurrent miss on the same audio got here first
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return;
+  }
+  Entry entry{key, text};
+  if (Cost(entry) > max_bytes_) {
+    return;
+  }
+  bytes_ += Cost(entry);
+  lru_.push_front(std::move(entry));
+  index_.emplace(key, lru_.begin());
+  while (bytes_ > max_bytes_) {
+    bytes_ -= Cost(lru_.back());
+    index_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+  metrics_.entries.store(index_.size(), std::memory_order_relaxed);
+  metrics_.bytes.store(bytes_, std::memory_order_relaxed);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "metrics.h"
+
+// 64-bit hash of a sample buffer that can be fed in pieces: the result only
+// depends on the samples, not on how they were split. It is SipHash-2-4
+// keyed with a secret drawn once per process, so clients can't compute
+// colliding uploads offline to be served someone else's transcript.
+class SampleHasher {
+public:
+  SampleHasher();
+  void Update(const float *samples, int64_t n);
+  uint64_t Digest() const;
+  int64_t NumSamples() const { return num_samples_; }
+
+private:
+  uint64_t v_[4];
+  uint64_t pending_ = 0; // the first sample of an odd count, not yet hashed
+  int64_t num_samples_ = 0;
+};
+
+// Bounded LRU map from audio to transcript, for traffic that submits the
+// same recordings again and again. Thread safe.
+class TranscriptCache {
+public:
+  struct Key {
+    uint64_t audio = 0;   // SampleHasher::Digest()
+    int64_t num_samples = 0;
+    uint64_t options = 0; // everything else the transcript depends on
+
+    bool operator==(const Key &o) const {
+      return audio == o.audio && num_samples == o.num_samples &&
+             options == o.options;
+    }
+  };
+
+  // max_bytes bounds the transcripts plus the bookkeeping of each entry
+  explicit TranscriptCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+  // Counts a hit or a miss; a hit becomes the most recently used entry
+  bool Get(const Key &key, std::string *text);
+  void Put(const Key &key, const std::string &text);
+
+  CacheMetrics &metrics() { return metrics_; }
+
+private:
+  struct KeyHash {
+    size_t operator()(const Key &k) const {
+      return k.audio ^ (k.options * 0x9e3779b97f4a7c15ull) ^ k.num_samples;
+    }
+  };
+  using Entry = std::pair<Key, std::string>;
+  // the entry, its list node and its index slot
+  static size_t Cost(const Entry &e) {
+    return sizeof(Entry) + 64 + e.second.size();
+  }
+
+  const size_t max_bytes_;
+  size_t bytes_ = 0;
+  std::mutex mx_;
+  std::list<Entry> lru_; // most recently used first
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+  CacheMetrics metrics_;
+};
@@ -7,7 +7,9 @@
 #include <cstring>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <onnxruntime_cxx_api.h>
 #include <sstream>
 #include <stdexcept>
@@ -19,17 +21,21 @@
 
 using namespace Ort;
 using namespace silero_vad;
-void SileroVAD::init_engine_threads(int inter_threads, int intra_threads) {
-  // The method should be called in each thread/proc in multi-thread/proc work
-  session_options.SetIntraOpNumThreads(intra_threads);
-  session_options.SetInterOpNumThreads(inter_threads);
-  session_options.SetGraphOptimizationLevel(
+std::shared_ptr<SileroVADModel>
+SileroVADModel::get(const std::string &model_path) {
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<SileroVADModel>> models;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto model = models[model_path].lock();
+  if (model) {
+    return model;
+  }
+  model = std::make_shared<SileroVADModel>();
+  // one thread each, the model is tiny and shared by many streams
+  model->session_options.SetIntraOpNumThreads(1);
+  model->session_options.SetInterOpNumThreads(1);
+  model->session_options.SetGraphOptimizationLevel(
       GraphOptimizationLevel::ORT_ENABLE_ALL);
-};
-
-void SileroVAD::init_onnx_model(const std::string &model_path) {
-  // Init threads = 1 for
-  init_engine_threads(1, 1);
   /*
   #ifdef __APPLE__
   uint32_t coreml_flags = 0;
@@ -38,9 +44,11 @@ void SileroVAD::init_onnx_model(const std::string &model_path) {
   Ort::ThrowOnError(OrtSessionOptionsAppendExecutionProvider_CoreML(session_options,
   coreml_flags)); #endif*/
   // Load model
-  session =
-      std::make_unique<Ort::Session>(env, model_path.c_str(), session_options);
-};
+  model->session = std::make_unique<Ort::Session>(
+      model->env, model_path.c_str(), model->session_options);
+  models[model_path] = model;
+  return model;
+}
 
 void SileroVAD::Reset() {
   // Call reset before each audio start
@@ -53,6 +61,11 @@ void SileroVAD::Reset() {
   prev_end = next_start = 0;
 };
 
+std::atomic<uint64_t> &SileroVAD::frames_total() {
+  static std::atomic<uint64_t> frames{0};
+  return frames;
+}
+
 std::string SileroVAD::predict(const std::vector<float> &data) {
   // Infer
   // Create ort tensors
@@ -74,7 +87,7 @@ std::string SileroVAD::predict(const std::vector<float> &data) {
   ort_inputs.emplace_back(std::move(c_ort));
 
   // Infer
-  ort_outputs = session->Run(
+  ort_outputs = model->session->Run(
       Ort::RunOptions{nullptr}, input_node_names.data(), ort_inputs.data(),
       ort_inputs.size(), output_node_names.data(), output_node_names.size());
 
@@ -85,6 +98,8 @@ std::string SileroVAD::predict(const std::vector<float> &data) {
   float *cn = ort_outputs[2].GetTensorMutableData<float>();
   std::memcpy(_c.data(), cn, size_hc * sizeof(float));
 
+  frames_total().fetch_add(1, std::memory_order_relaxed);
+
   // Push forward sample index
   current_sample += window_size_samples;
 
@@ -95,14 +110,14 @@ std::string SileroVAD::predict(const std::vector<float> &data) {
     triggered = true;
     // int speech_start = current_sample - speech_pad_samples -
     // window_size_samples;
-    if (triggered) {
+    if (keep_speech) {
       for (auto d : data) {
         _buffer.push_back(d * 32768);
       }
     }
     return "start";
   }
-  if (triggered) {
+  if (triggered && keep_speech) {
     for (auto d : data) {
       _buffer.push_back(d * 32768);
     }
@@ -129,7 +144,7 @@ SileroVAD::SileroVAD(const std::string &ModelPath, SampleRate Sample_rate,
                      const std::chrono::milliseconds &speech_pad_ms,
                      const std::chrono::milliseconds &min_speech_duration_ms,
                      const std::chrono::seconds &max_speech_duration_s) {
-  init_onnx_model(ModelPath);
+  model = SileroVADModel::get(ModelPath);
   threshold = Threshold;
   sample_rate = static_cast<uint32_t>(Sample_rate);
   int sr_per_ms = sample_rate / 1000;
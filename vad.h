@@ -8,21 +8,24 @@
 #include <vector>
 
 namespace silero_vad {
-class SileroVAD {
-private:
-  // OnnxRuntime resources
+// The onnx session of silero vad. It holds no per-stream state (h/c live in
+// SileroVAD), so one instance is shared by every SileroVAD of the process.
+struct SileroVADModel {
   Ort::Env env;
   Ort::SessionOptions session_options;
   std::unique_ptr<Ort::Session> session = nullptr;
+
+  static std::shared_ptr<SileroVADModel> get(const std::string &model_path);
+};
+
+class SileroVAD {
+private:
+  // OnnxRuntime resources
+  std::shared_ptr<SileroVADModel> model;
   Ort::AllocatorWithDefaultOptions allocator;
   Ort::MemoryInfo memory_info =
       Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeCPU);
 
-private:
-  void init_engine_threads(int inter_threads, int intra_threads);
-
-  void init_onnx_model(const std::string &model_path);
-
 public:
   enum class SampleRate : uint32_t { SR_16K = 16000, SR_8K = 8000 };
   enum class FrameMS : uint32_t { WS_32 = 32, WS_64 = 64, WS_96 = 96 };
@@ -42,8 +45,22 @@ public:
    */
   void Reset();
 
+  // Windows run through the model by every instance, for metrics
+  static std::atomic<uint64_t> &frames_total();
+
+  // Keep the windows of the current speech for Data(), off by default:
+  // callers that take the audio elsewhere would otherwise hold a second
+  // copy of all of it
+  void KeepSpeech(bool keep) {
+    keep_speech = keep;
+    if (!keep) {
+      _buffer.clear();
+    }
+  }
+
   /**
-   * @brief
+   * @brief The speech since the last call, once it has ended; needs
+   * KeepSpeech(true)
    */
   void Data(std::vector<float> &data) {
     if (triggered == false) {
@@ -91,6 +108,7 @@ private:
   std::vector<const char *> output_node_names = {"output", "hn", "cn"};
 
   // Buffer
+  bool keep_speech = false;
   std::vector<float> _buffer;
 
 public:
@@ -0,0 +1,83 @@
+#include "vad_segmenter.h"
+
+#include <algorithm>
+
+VadSegmenter::VadSegmenter(std::unique_ptr<OnlineSenseVoiceFeature> feature,
+                           const std::string &vad_onnx,
+                           int64_t max_segment_samples)
+    : vad_(vad_onnx), feature_(std::move(feature)),
+      max_segment_samples_(max_segment_samples), scaled_(kWindow) {
+  vad_.Reset();
+  pending_.reserve(kWindow);
+}
+
+void VadSegmenter::AcceptWaveform(const float *samples, int32_t n,
+                                  const Callback &on_segment) {
+  // top up a partial window first
+  if (!pending_.empty()) {
+    int32_t k = std::min<int32_t>(kWindow - pending_.size(), n);
+    pending_.insert(pending_.end(), samples, samples + k);
+    samples += k;
+    n -= k;
+    if (pending_.size() < kWindow) {
+      return;
+    }
+    ProcessWindow(pending_.data(), on_segment);
+    pending_.clear();
+  }
+  for (; n >= kWindow; samples += kWindow, n -= kWindow) {
+    ProcessWindow(samples, on_segment);
+  }
+  pending_.assign(samples, samples + n);
+}
+
+void VadSegmenter::InputFinished(const Callback &on_segment) {
+  if (in_speech_) {
+    feature_->AcceptWaveform(pending_.data(), pending_.size());
+    EndSegment(num_samples_ + pending_.size(), on_segment);
+  }
+  pending_.clear();
+}
+
+void VadSegmenter::ProcessWindow(const float *window,
+                                 const Callback &on_segment) {
+  std::transform(window, window + kWindow, scaled_.begin(),
+                 [](float x) { return x / 32768.0f; });
+  auto trigger = vad_.predict(scaled_);
+  int64_t start = num_samples_;
+  num_samples_ += kWindow;
+
+  if (trigger == "start" && !in_speech_) {
+    // the VAD fires a window late, keep the one before as pre-roll
+    StartSegment(start - static_cast<int64_t>(prev_.size()));
+    feature_->AcceptWaveform(prev_.data(), prev_.size());
+  }
+  if (in_speech_) {
+    feature_->AcceptWaveform(window, kWindow);
+    if (trigger == "end") {
+      EndSegment(num_samples_, on_segment);
+    } else if (num_samples_ - segment_start_ >= max_segment_samples_) {
+      // still speech, go on in a new segment
+      EndSegment(num_samples_, on_segment);
+      StartSegment(num_samples_);
+    }
+  }
+  prev_.assign(window, window + kWindow);
+}
+
+void VadSegmenter::StartSegment(int64_t start) {
+  in_speech_ = true;
+  segment_start_ = std::max<int64_t>(0, start);
+}
+
+void VadSegmenter::EndSegment(int64_t end, const Callback &on_segment) {
+  feature_->InputFinished();
+  Segment segment;
+  segment.index = next_index_++;
+  segment.start = segment_start_;
+  segment.end = end;
+  segment.feats = std::move(feature_->Feats());
+  feature_->Reset();
+  in_speech_ = false;
+  on_segment(std::move(segment));
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sense_voice_feature.h"
+#include "vad.h"
+
+// Cuts a long recording into speech segments with Silero VAD and computes
+// the SenseVoice features of each segment while the audio is fed, so a
+// segment can be submitted for recognition as soon as it ends.
+//
+// Segments longer than max_segment_samples are split, keeping the encoder
+// input bounded no matter how long a speaker goes on.
+class VadSegmenter {
+public:
+  struct Segment {
+    int32_t index;
+    int64_t start; // first sample
+    int64_t end;   // one past the last sample
+    std::vector<float> feats;
+  };
+  using Callback = std::function<void(Segment &&)>;
+
+  // feature is the (empty) front end of the recognizer, see
+  // Recognizer::create_feature()
+  VadSegmenter(std::unique_ptr<OnlineSenseVoiceFeature> feature,
+               const std::string &vad_onnx, int64_t max_segment_samples);
+
+  // samples are 16kHz mono, scaled to the int16 range. on_segment is
+  // called for every segment that ends within them.
+  void AcceptWaveform(const float *samples, int32_t n,
+                      const Callback &on_segment);
+
+  // No more audio, ends the open segment if there is one.
+  void InputFinished(const Callback &on_segment);
+
+  // Segments emitted so far
+  int32_t NumSegments() const { return next_index_; }
+
+private:
+  void ProcessWindow(const float *window, const Callback &on_segment);
+  void StartSegment(int64_t start);
+  void EndSegment(int64_t end, const Callback &on_segment);
+
+  static constexpr int32_t kWindow = 512; // 32ms, what the VAD expects
+
+  silero_vad::SileroVAD vad_;
+  std::unique_ptr<OnlineSenseVoiceFeature> feature_;
+  int64_t max_segment_samples_;
+
+  std::vector<float> pending_; // < kWindow samples not yet seen by the VAD
+  std::vector<float> prev_;    // the window before the current, pre-roll
+  std::vector<float> scaled_;  // the window in [-1, 1] for the VAD
+  int64_t num_samples_ = 0;    // samples passed to the VAD
+  bool in_speech_ = false;
+  int64_t segment_start_ = 0;
+  int32_t next_index_ = 0;
+};
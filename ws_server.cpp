@@ -1,12 +1,51 @@
 #include "ws_server.h"
 #include "config.h"
+#include "prometheus.h"
 #include <mutex>
+#include <nlohmann/json.hpp>
+#include <sys/socket.h>
+
+void UploadStream::Append(const uint8_t *p, int32_t n) {
+  int32_t bps = BytesPerSample(format);
+  float *out = nullptr; // where sample num_samples goes
+  if (upload->segmented) {
+    // chunk holds the samples since the last hand over to the features
+    // stage, i.e. from sample posted on
+    chunk.resize(num_samples - posted + (num_partial + n) / bps);
+    out = chunk.data() + (num_samples - posted);
+  } else {
+    out = upload->audio->data() + num_samples;
+  }
+  if (num_partial > 0) {
+    int32_t k = std::min(bps - num_partial, n);
+    std::copy(p, p + k, partial + num_partial);
+    num_partial += k;
+    p += k;
+    n -= k;
+    if (num_partial < bps) {
+      return;
+    }
+    DecodeSamples(format, partial, 1, out++);
+    ++num_samples;
+    num_partial = 0;
+  }
+  int32_t full = n / bps;
+  DecodeSamples(format, p, full, out);
+  num_samples += full;
+  num_partial = n - full * bps;
+  std::copy(p + full * bps, p + n, partial);
+}
 
-OfflineWebsocketServer::~OfflineWebsocketServer() {}
+OfflineWebsocketServer::~OfflineWebsocketServer() {
+  // drain the stages while the model is still alive
+  local_.reset();
+  reporter_.reset();
+  features_.reset();
+  decode_.reset();
+}
 
-OfflineWebsocketServer::OfflineWebsocketServer(asio::io_context &io_context,
-                                               asio::io_context &work_context)
-    : io_conn_(io_context), io_work_(work_context) {
+OfflineWebsocketServer::OfflineWebsocketServer(asio::io_context &io_context)
+    : io_conn_(io_context) {
   // server_.init_asio(&io_conn_);
   server_.init_asio(&io_conn_);
 
@@ -17,6 +56,8 @@ OfflineWebsocketServer::OfflineWebsocketServer(asio::io_context &io_context,
 
   server_.set_close_handler([this](connection_hdl hdl) { OnClose(hdl); });
 
+  server_.set_http_handler([this](connection_hdl hdl) { OnHttp(hdl); });
+
   server_.set_message_handler(
       [this](connection_hdl hdl, server::message_ptr msg) {
         OnMessage(hdl, msg);
@@ -24,26 +65,45 @@ OfflineWebsocketServer::OfflineWebsocketServer(asio::io_context &io_context,
 
   _batch_sense_voice = std::make_unique<BatchSenseVoice>();
   _batch_sense_voice->init(CONFIG::asr_onnx, CONFIG::tokens);
+  if (CONFIG::transcript_cache_mb > 0) {
+    _batch_sense_voice->set_cache(
+        static_cast<size_t>(CONFIG::transcript_cache_mb) << 20);
+  }
+
+  features_ = std::make_unique<Stage>("features", CONFIG::num_feature_threads,
+                                      CONFIG::stage_queue_size);
+  decode_ = std::make_unique<Stage>("decode", CONFIG::num_decode_threads,
+                                    CONFIG::stage_queue_size);
+  auto *session = OnnxEngine::get_inst()->session(_batch_sense_voice->name_);
+  reporter_ = std::make_unique<StageReporter>(
+      std::vector<StageMetrics *>{&receive_metrics_, &features_->metrics(),
+                                  &session->_metrics, &decode_->metrics()},
+      std::chrono::seconds(CONFIG::metrics_interval), &trim_metrics_,
+      _batch_sense_voice->cache() ? &_batch_sense_voice->cache()->metrics()
+                                  : nullptr);
   // _batch_sense_voice =
   //     std::make_unique<SenseVoice>(CONFIG::asr_onnx, CONFIG::tokens);
 }
 
 void OfflineWebsocketServer::OfflineWebsocketServer::OnOpen(
     connection_hdl hdl) {
+  auto con = server_.get_con_from_hdl(hdl);
+  con->data.timings =
+      con->get_resource().find("timings=1") != std::string::npos;
+  con->open.store(true, std::memory_order_release);
 
-  std::lock_guard<std::mutex> lock(mutex_);
-  connections_.emplace(hdl, std::make_shared<ConnectionData>());
-
-  PLOGI << "Number of active connections: "
-        << static_cast<int32_t>(connections_.size());
+  PLOGI << "Number of active connections: " << ++num_connections_;
 }
 
 void OfflineWebsocketServer::OnClose(connection_hdl hdl) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  connections_.erase(hdl);
+  auto con = server_.get_con_from_hdl(hdl);
+  con->open.store(false, std::memory_order_release);
+  // Tasks in the stages only hold a weak handle, so the connection object
+  // may live on for a while; drop the uploads in progress right away.
+  con->data.single.Clear();
+  con->data.streams.clear();
 
-  PLOGI << "Number of active connections: "
-        << static_cast<int32_t>(connections_.size());
+  PLOGI << "Number of active connections: " << --num_connections_;
 }
 
 void OfflineWebsocketServer::Close(connection_hdl hdl,
@@ -66,26 +126,22 @@ void OfflineWebsocketServer::Close(connection_hdl hdl,
 
 void OfflineWebsocketServer::Send(connection_hdl hdl, const std::string &text) {
   websocketpp::lib::error_code ec;
-  if (!Contains(hdl)) {
-    return;
+  auto con = server_.get_con_from_hdl(hdl, ec);
+  if (ec || !con->open.load(std::memory_order_acquire)) {
+    return; // the client went away while its request was running
   }
 
-  server_.send(hdl, text, websocketpp::frame::opcode::text, ec);
+  ec = con->send(text, websocketpp::frame::opcode::text);
   if (ec) {
     server_.get_alog().write(websocketpp::log::alevel::app, ec.message());
   }
 }
 
-bool OfflineWebsocketServer::Contains(connection_hdl hdl) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return connections_.count(hdl);
-}
-
 void OfflineWebsocketServer::OnMessage(connection_hdl hdl,
                                        server::message_ptr msg) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  auto connection_data = connections_.find(hdl)->second;
-  lock.unlock();
+  auto start = std::chrono::steady_clock::now();
+  auto con = server_.get_con_from_hdl(hdl);
+  auto &connection_data = con->data;
   const std::string &payload = msg->get_payload();
 
   switch (msg->get_opcode()) {
@@ -101,83 +157,583 @@ void OfflineWebsocketServer::OnMessage(connection_hdl hdl,
     break;
 
   case websocketpp::frame::opcode::binary: {
-    auto p = reinterpret_cast<const int8_t *>(payload.data());
+    auto p = reinterpret_cast<const uint8_t *>(payload.data());
+    int32_t n = payload.size();
 
-    if (connection_data->expected_byte_size == 0) {
-      if (payload.size() < 8) {
-        Close(hdl, websocketpp::close::status::normal, "Payload is too short");
-        break;
-      }
+    if (connection_data.mode == ConnectionData::Mode::kUnknown) {
+      bool tagged = n >= 4 && (p[3] & 0x80);
+      connection_data.mode = tagged ? ConnectionData::Mode::kMultiplexed
+                                    : ConnectionData::Mode::kSingle;
+    }
+    if (connection_data.mode == ConnectionData::Mode::kSingle) {
+      Receive(hdl, connection_data.single, -1, p, n);
+      break;
+    }
+
+    uint32_t tag = 0;
+    if (n >= 4) {
+      tag = *reinterpret_cast<const uint32_t *>(p);
+    }
+    if (!(tag & 0x80000000u)) {
+      Close(hdl, websocketpp::close::status::protocol_error,
+            "Missing request id");
+      break;
+    }
+    uint32_t id = tag & 0x7FFFFFFFu;
+    auto &streams = connection_data.streams;
+    if (!streams.count(id) &&
+        static_cast<int32_t>(streams.size()) >=
+            CONFIG::max_streams_per_connection) {
+      Close(hdl, websocketpp::close::status::policy_violation,
+            "Too many concurrent requests");
+      break;
+    }
+    auto &stream = streams[id];
+    if (Receive(hdl, stream, id, p + 4, n - 4) &&
+        stream.expected_byte_size == 0) {
+      streams.erase(id); // complete, handed to the features stage
+    }
+    break;
+  }
+
+  default:
+    // Unexpected message, ignore it
+    break;
+  }
+  receive_metrics_.add(elapsed_ns(start), 0);
+}
+
+bool OfflineWebsocketServer::Receive(connection_hdl hdl, UploadStream &s,
+                                     int64_t id, const uint8_t *p,
+                                     int32_t n) {
+  if (s.expected_byte_size == 0) {
+    if (n < 8) {
+      Close(hdl, websocketpp::close::status::normal, "Payload is too short");
+      return false;
+    }
+
+    int32_t header = *reinterpret_cast<const int32_t *>(p);
+    s.sample_rate = header & 0x00FFFFFF;
+    if (s.sample_rate < 1000 || s.sample_rate > 192000) {
+      Close(hdl, websocketpp::close::status::normal, "Unsupported sample rate");
+      return false;
+    }
+    if (!ParseSampleFormat(static_cast<uint32_t>(header) >> 24, &s.format)) {
+      Close(hdl, websocketpp::close::status::normal,
+            "Unsupported sample format");
+      return false;
+    }
+    int32_t bps = BytesPerSample(s.format);
 
-      connection_data->sample_rate = *reinterpret_cast<const int32_t *>(p);
+    s.expected_byte_size = *reinterpret_cast<const int32_t *>(p + 4);
+    if (s.expected_byte_size < 0) {
+      Close(hdl, websocketpp::close::status::normal, "Invalid payload size");
+      return false;
+    }
 
-      connection_data->expected_byte_size =
-          *reinterpret_cast<const int32_t *>(p + 4);
+    // int32_t max_byte_size_ = decoder_.GetConfig().max_utterance_length *
+    //                          s.sample_rate * sizeof(float);
+    int64_t max_byte_size_ =
+        static_cast<int64_t>(CONFIG::max_upload_length) * s.sample_rate * bps;
+    if (s.expected_byte_size > max_byte_size_) {
+      float num_samples = s.expected_byte_size / bps;
+
+      float duration = num_samples / s.sample_rate;
+
+      std::ostringstream os;
+      os << "Max upload length is configured to " << CONFIG::max_upload_length
+         << " seconds, received length is " << duration << " seconds. "
+         << "Payload is too large!";
+      Close(hdl, websocketpp::close::status::message_too_big, os.str());
+      return false;
+    }
 
-      // int32_t max_byte_size_ = decoder_.GetConfig().max_utterance_length *
-      //                          connection_data->sample_rate * sizeof(float);
-      int32_t max_byte_size_ = CONFIG::max_utterance_length *
-                               connection_data->sample_rate * sizeof(float);
-      if (connection_data->expected_byte_size > max_byte_size_) {
-        float num_samples = connection_data->expected_byte_size / sizeof(float);
+    auto upload = NewUpload(s.expected_byte_size / bps, s.sample_rate);
+    if (!upload->segmented) {
+      upload->audio =
+          AudioBufferPool::get().acquire(s.expected_byte_size / bps);
+      upload->samples = upload->audio->data();
+    }
+    upload->id = id;
+    upload->timings = server_.get_con_from_hdl(hdl)->data.timings;
+    upload->reply = [this, hdl](const std::string &text, bool) {
+      Send(hdl, text);
+    };
+    s.upload = upload;
+    // a trailing partial sample is never read
+    s.expected_byte_size -= s.expected_byte_size % bps;
+    int32_t k = std::min(n - 8, s.expected_byte_size);
+    s.Append(p + 8, k);
+    s.cur = k;
+  } else {
+    int32_t k = std::min(n, s.expected_byte_size - s.cur);
+    s.Append(p, k);
+    s.cur += k;
+  }
 
-        float duration = num_samples / connection_data->sample_rate;
+  // Start fbank/LFR on what has arrived so far, so that only the encoder
+  // and decoding are left once the last byte lands. The features stage
+  // only reads samples below num_samples, which this thread no longer
+  // writes.
+  int32_t num_samples = s.num_samples;
+  bool finished = s.expected_byte_size == s.cur;
+  if (finished || num_samples - s.posted >= CONFIG::feature_chunk_samples) {
+    auto upload = s.upload;
+    s.posted = num_samples;
+    Upload::Chunk chunk;
+    int32_t seq = s.num_chunks++;
+    if (upload->segmented) {
+      chunk = std::make_shared<std::vector<float>>(std::move(s.chunk));
+      s.chunk.clear();
+    }
+    if (finished) {
+      upload->complete = std::chrono::steady_clock::now();
+      Tracer::get().Record(upload->trace_id, "receive", upload->begin,
+                           upload->complete);
+      // Clear it so that we can handle the next audio file from the
+      // client. The client can send multiple audio files for recognition
+      // without the need to create another connection.
+      s.Clear();
+    }
 
-        std::ostringstream os;
-        os << "Max utterance length is configured to "
-           << CONFIG::max_utterance_length << " seconds, received length is "
-           << duration << " seconds. "
-           << "Payload is too large!";
-        Close(hdl, websocketpp::close::status::message_too_big, os.str());
+    // blocks this io thread while the features stage is full
+    if (upload->segmented) {
+      features_->post(
+          [this, upload, seq, chunk, finished]() {
+            ExtractSegments(upload, seq, chunk, finished);
+          },
+          upload->trace_id);
+    } else {
+      features_->post(
+          [this, upload, num_samples, finished]() {
+            ExtractFeatures(upload, num_samples, finished);
+          },
+          upload->trace_id);
+    }
+  }
+  return true;
+}
+
+UploadPtr OfflineWebsocketServer::NewUpload(int64_t num_samples,
+                                           int32_t sample_rate) {
+  auto upload = std::make_shared<Upload>();
+  upload->sample_rate = sample_rate;
+  upload->duration = static_cast<double>(num_samples) / sample_rate;
+  upload->begin = std::chrono::steady_clock::now();
+  upload->trace_id = Tracer::get().NewId();
+  if (num_samples >
+      static_cast<int64_t>(CONFIG::max_utterance_length) * sample_rate) {
+    upload->segmented = true;
+    upload->segmenter = std::make_unique<VadSegmenter>(
+        _batch_sense_voice->create_feature(), CONFIG::vad_onnx,
+        static_cast<int64_t>(CONFIG::max_utterance_length) *
+            CONFIG::asr_sample_rate);
+  } else {
+    upload->feature = _batch_sense_voice->create_feature();
+    if (CONFIG::trim_silence) {
+      upload->trimmer = std::make_unique<SilenceTrimmer>(
+          CONFIG::trim_pad_ms, CONFIG::trim_range_db, CONFIG::trim_floor_db);
+    }
+    if (_batch_sense_voice->cache()) {
+      upload->hasher = std::make_unique<SampleHasher>();
+    }
+  }
+  if (sample_rate != CONFIG::asr_sample_rate) {
+    // the filter is cached per rate pair, only the state is new
+    upload->resampler = sherpa_onnx::LinearResample::Create(
+        sample_rate, CONFIG::asr_sample_rate);
+  }
+  return upload;
+}
+
+void OfflineWebsocketServer::OnLocalRequest(LocalListener::Request &&req) {
+  if (req.num_samples >
+      static_cast<int64_t>(CONFIG::max_upload_length) * req.sample_rate) {
+    req.fail("Payload is too large!");
+    return;
+  }
+  auto upload = NewUpload(req.num_samples, req.sample_rate);
+  upload->reply = std::move(req.reply);
+  upload->complete = std::chrono::steady_clock::now();
+  int32_t num_samples = req.num_samples;
+  if (upload->segmented) {
+    // ExtractSegments() takes its audio as a chunk; past it, the segmenter
+    // only holds a window or two and the features of the open segment
+    auto chunk = std::make_shared<std::vector<float>>(
+        req.samples, req.samples + req.num_samples);
+    features_->post(
+        [this, upload, chunk]() { ExtractSegments(upload, 0, chunk, true); },
+        upload->trace_id);
+  } else {
+    // features are computed straight from the client's ring
+    upload->samples = req.samples;
+    upload->mapping = std::move(req.ring);
+    features_->post(
+        [this, upload, num_samples]() {
+          ExtractFeatures(upload, num_samples, true);
+        },
+        upload->trace_id);
+  }
+}
+
+void OfflineWebsocketServer::ExtractFeatures(UploadPtr upload,
+                                             int32_t num_samples,
+                                             bool finished) {
+  // Tasks of one upload may run concurrently or out of order on different
+  // threads; each one catches up to its own num_samples, so whichever runs
+  // last with finished set submits the complete utterance.
+  TraceSpan span(upload->trace_id, "features");
+  std::unique_lock<std::mutex> lock(upload->mx);
+  if (upload->submitted) {
+    return;
+  }
+  auto *hasher = upload->hasher.get();
+  if (hasher && num_samples > hasher->NumSamples()) {
+    hasher->Update(upload->samples + hasher->NumSamples(),
+                   num_samples - hasher->NumSamples());
+  }
+  TranscriptCache::Key key;
+  if (finished && hasher) {
+    // Checked before the last samples go through the front end; a local
+    // request arrives in one piece and skips it entirely.
+    key = _batch_sense_voice->cache_key(*hasher, upload->sample_rate,
+                                        upload->trimmer != nullptr);
+    std::string text;
+    if (_batch_sense_voice->cache()->Get(key, &text)) {
+      upload->submitted = true;
+      upload->ReleaseInput();
+      lock.unlock();
+      SendResult(*upload, text);
+      return;
+    }
+  }
+  if (upload->resampler) {
+    // The resampler keeps the tail it still needs, so only the new samples
+    // are passed; the last call flushes it.
+    if (num_samples > upload->fed || finished) {
+      upload->resampler->Resample(upload->samples + upload->fed,
+                                  num_samples - upload->fed, finished,
+                                  &upload->resampled);
+      upload->fed = num_samples;
+      upload->feature->AcceptWaveform(upload->resampled.data(),
+                                      upload->resampled.size());
+      if (upload->trimmer) {
+        upload->trimmer->AcceptWaveform(upload->resampled.data(),
+                                        upload->resampled.size());
+      }
+    }
+  } else if (num_samples > upload->fed) {
+    if (upload->trimmer) {
+      upload->trimmer->AcceptWaveform(upload->samples + upload->fed,
+                                      num_samples - upload->fed);
+    }
+    upload->fed = num_samples;
+    upload->feature->AcceptBuffered(upload->samples, num_samples);
+  }
+  if (!finished) {
+    return;
+  }
+  upload->feature->InputFinished();
+  upload->submitted = true;
+  auto feats = std::move(upload->feature->Feats());
+  if (upload->trimmer) {
+    // LFR frames are independent after CMVN, so cutting rows is the same
+    // as cutting the audio
+    int32_t dim = upload->feature->FeatureDim();
+    int32_t shift = upload->feature->WindowShift();
+    int32_t num_frames = feats.size() / dim;
+    auto range = upload->trimmer->Range(num_frames, shift);
+    feats.resize(static_cast<size_t>(range.second) * dim);
+    feats.erase(feats.begin(), feats.begin() + range.first * dim);
+    trim_metrics_.add(num_frames * shift * 10,
+                      (range.second - range.first) * shift * 10);
+  }
+  upload->ReleaseInput(); // back to the pool before waiting on the engine
+  bool cacheable = hasher != nullptr;
+  lock.unlock();
+
+  Submit(std::move(feats), upload->trace_id,
+         [this, upload, key, cacheable](const std::string &text) {
+           if (cacheable) {
+             _batch_sense_voice->cache()->Put(key, text);
+           }
+           SendResult(*upload, text);
+         });
+}
+
+void OfflineWebsocketServer::SendResult(Upload &upload,
+                                        const std::string &text) {
+  request_metrics_.add(elapsed_ns(upload.complete) / 1e9, upload.duration);
+  Tracer::get().Record(upload.trace_id, "request", upload.begin);
+  if (upload.id < 0 && !upload.timings) {
+    upload.reply(text, true);
+    return;
+  }
+  // tagged results go out as soon as they are ready, in any order
+  nlohmann::json j;
+  if (upload.id >= 0) {
+    j["id"] = upload.id;
+  }
+  j["text"] = text;
+  if (upload.timings) {
+    j["trace"] = upload.trace_id;
+    j["timings"] = Tracer::get().Timings(upload.trace_id, upload.begin);
+  }
+  upload.reply(j.dump(), true);
+}
+
+void OfflineWebsocketServer::ExtractSegments(UploadPtr upload, int32_t seq,
+                                             Upload::Chunk chunk,
+                                             bool finished) {
+  // Unlike ExtractFeatures() the chunks are disjoint, so they must go
+  // through the vad in order: a chunk that overtook its predecessor waits
+  // in upload->chunks for the task of the predecessor to pick it up.
+  TraceSpan span(upload->trace_id, "features");
+  std::vector<VadSegmenter::Segment> segments;
+  auto on_segment = [&segments](VadSegmenter::Segment &&segment) {
+    segments.push_back(std::move(segment));
+  };
+  int32_t num_segments = -1;
+  {
+    std::lock_guard<std::mutex> lock(upload->mx);
+    upload->chunks.emplace(seq, std::make_pair(std::move(chunk), finished));
+    for (auto it = upload->chunks.find(upload->next_chunk);
+         it != upload->chunks.end();
+         it = upload->chunks.find(upload->next_chunk)) {
+      auto &samples = *it->second.first;
+      bool last = it->second.second;
+      if (upload->resampler) {
+        upload->resampler->Resample(samples.data(), samples.size(), last,
+                                    &upload->resampled);
+        upload->segmenter->AcceptWaveform(upload->resampled.data(),
+                                          upload->resampled.size(),
+                                          on_segment);
+      } else {
+        upload->segmenter->AcceptWaveform(samples.data(), samples.size(),
+                                          on_segment);
+      }
+      upload->chunks.erase(it);
+      ++upload->next_chunk;
+      if (last) {
+        upload->segmenter->InputFinished(on_segment);
+        num_segments = upload->segmenter->NumSegments();
+        upload->segmenter.reset();
+        upload->resampler.reset();
         break;
       }
+    }
+  }
 
-      connection_data->data.resize(connection_data->expected_byte_size);
-      std::copy(payload.begin() + 8, payload.end(),
-                connection_data->data.data());
-      connection_data->cur = payload.size() - 8;
-    } else {
-      std::copy(payload.begin(), payload.end(),
-                connection_data->data.data() + connection_data->cur);
-      connection_data->cur += payload.size();
-    }
-
-    if (connection_data->expected_byte_size == connection_data->cur) {
-      auto d = std::make_shared<ConnectionData>(std::move(*connection_data));
-      // Clear it so that we can handle the next audio file from the client.
-      // The client can send multiple audio files for recognition without
-      // the need to create another connection.
-      connection_data->sample_rate = 0;
-      connection_data->expected_byte_size = 0;
-      connection_data->cur = 0;
-
-      // decoder_.Push(hdl, d);
-
-      connection_data->Clear();
-
-      // asio::post(io_work_, [this]() { decoder_.Decode(); });
-      asio::post(io_work_, ([this, hdl, d]() {
-                   std::vector<float> data(d->data.size());
-                   auto samples = reinterpret_cast<const float *>(&d->data[0]);
-                   auto num_samples = d->expected_byte_size / sizeof(float);
-                   for (int i = 0; i < num_samples; ++i) {
-                     data[i] = samples[i];
-                   }
-                   auto asr = this->_batch_sense_voice->recog(data);
-                   this->Send(hdl, asr);
-                 }));
+  for (auto &segment : segments) {
+    int32_t index = segment.index;
+    float start = segment.start / static_cast<float>(CONFIG::asr_sample_rate);
+    float end = segment.end / static_cast<float>(CONFIG::asr_sample_rate);
+    Submit(std::move(segment.feats), upload->trace_id,
+           [this, upload, index, start, end](const std::string &text) {
+             nlohmann::json j;
+             if (upload->id >= 0) {
+               j["id"] = upload->id;
+             }
+             j["segment"] = index;
+             j["start"] = start;
+             j["end"] = end;
+             j["text"] = text;
+             {
+               std::lock_guard<std::mutex> lock(upload->result_mx);
+               upload->results[index] = j.dump();
+             }
+             DeliverSegments(*upload);
+           });
+  }
+
+  if (num_segments >= 0) {
+    {
+      std::lock_guard<std::mutex> lock(upload->result_mx);
+      upload->num_segments = num_segments;
     }
-    break;
+    // all segments may have been delivered already
+    DeliverSegments(*upload);
   }
+}
 
-  default:
-    // Unexpected message, ignore it
-    break;
+void OfflineWebsocketServer::Submit(
+    std::vector<float> &&feats, uint64_t trace_id,
+    std::function<void(const std::string &)> on_text) {
+  auto req = _batch_sense_voice->make_request(std::move(feats));
+  req->_trace_id = trace_id;
+
+  // The batcher has no queue limit of its own
+  inflight_.acquire();
+  req->_on_done = [this, req, on_text]() {
+    inflight_.release();
+    decode_->post(
+        [this, req, on_text]() {
+          std::string text;
+          {
+            TraceSpan span(req->_trace_id, "decode");
+            text = _batch_sense_voice->decode(*req);
+          }
+          on_text(text);
+        },
+        req->_trace_id);
+  };
+  OnnxEngine::get_inst()->request_async(_batch_sense_voice->name_, req);
+}
+
+void OfflineWebsocketServer::DeliverSegments(Upload &upload) {
+  // Sending under the lock keeps the messages in segment order
+  std::lock_guard<std::mutex> lock(upload.result_mx);
+  for (auto it = upload.results.find(upload.next_result);
+       it != upload.results.end();
+       it = upload.results.find(upload.next_result)) {
+    upload.reply(it->second, false);
+    upload.results.erase(it);
+    ++upload.next_result;
+  }
+  if (upload.next_result == upload.num_segments && !upload.done_sent) {
+    nlohmann::json j;
+    if (upload.id >= 0) {
+      j["id"] = upload.id;
+    }
+    j["done"] = true;
+    j["segments"] = upload.num_segments;
+    request_metrics_.add(elapsed_ns(upload.complete) / 1e9, upload.duration);
+    Tracer::get().Record(upload.trace_id, "request", upload.begin);
+    if (upload.timings) {
+      // summed over the segments, which overlap
+      j["trace"] = upload.trace_id;
+      j["timings"] = Tracer::get().Timings(upload.trace_id, upload.begin);
+    }
+    upload.reply(j.dump(), true);
+    upload.done_sent = true;
+  }
+}
+
+void OfflineWebsocketServer::OnHttp(connection_hdl hdl) {
+  auto con = server_.get_con_from_hdl(hdl);
+  const std::string &resource = con->get_resource();
+  if (resource == "/metrics") {
+    con->set_status(websocketpp::http::status_code::ok);
+    con->append_header("Content-Type", "text/plain; version=0.0.4");
+    con->set_body(RenderMetrics());
+  } else if (resource.compare(0, 6, "/trace") == 0) {
+    uint64_t request = 0;
+    auto pos = resource.find("request=");
+    if (pos != std::string::npos) {
+      request = std::strtoull(resource.c_str() + pos + 8, nullptr, 10);
+    }
+    con->set_status(websocketpp::http::status_code::ok);
+    con->append_header("Content-Type", "application/json");
+    con->set_body(Tracer::get().ChromeJson(request));
+  } else {
+    con->set_status(websocketpp::http::status_code::not_found);
+    con->set_body("Not found\n");
+  }
+}
+
+std::string OfflineWebsocketServer::RenderMetrics() {
+  // Only reads atomics, except for the session queue depths
+  PrometheusWriter w;
+  w.Gauge("asr_active_connections", "Open websocket connections",
+          num_connections_.load(std::memory_order_relaxed));
+
+  std::vector<StageMetrics *> stages = {
+      &receive_metrics_, &features_->metrics(),
+      &OnnxEngine::get_inst()->session(_batch_sense_voice->name_)->_metrics,
+      &decode_->metrics()};
+  auto stage = [](const StageMetrics *m) {
+    return PrometheusWriter::Label("stage", m->name);
+  };
+  for (auto *m : stages) {
+    w.Counter("asr_stage_items_total", "Work items finished by a stage",
+              m->items.load(std::memory_order_relaxed), stage(m));
+  }
+  for (auto *m : stages) {
+    w.Hist("asr_stage_busy_seconds", "Time a stage spent on one item",
+           m->busy_seconds, stage(m));
   }
+  for (auto *m : stages) {
+    if (m != &receive_metrics_) { // handled as it arrives
+      w.Hist("asr_stage_wait_seconds", "Time an item queued for a stage",
+             m->wait_seconds, stage(m));
+    }
+  }
+
+  std::vector<std::pair<std::string, OnnxSession *>> sessions;
+  OnnxEngine::get_inst()->for_each_session(
+      [&sessions](const std::string &name, OnnxSession &session) {
+        sessions.emplace_back(PrometheusWriter::Label("session", name),
+                              &session);
+      });
+  for (auto &s : sessions) {
+    w.Gauge("asr_session_queue_depth",
+            "Requests waiting for a batch in an OnnxSession",
+            s.second->_metrics.depth ? s.second->_metrics.depth() : 0,
+            s.first);
+  }
+  for (auto &s : sessions) {
+    w.Hist("asr_batch_size", "Requests per onnxruntime run",
+           s.second->_batch_metrics.size, s.first);
+  }
+  for (auto &s : sessions) {
+    w.Hist("asr_batch_padding_ratio", "Padded frames over all batch frames",
+           s.second->_batch_metrics.padding, s.first);
+  }
+  for (auto &s : sessions) {
+    w.Hist("asr_ort_run_seconds", "Duration of one onnxruntime run",
+           s.second->_batch_metrics.run_seconds, s.first);
+  }
+
+  w.Hist("asr_request_rtf",
+         "Seconds from the last sample received to the transcript, per "
+         "second of audio",
+         request_metrics_.rtf);
+  w.Counter("asr_audio_seconds_total", "Audio transcribed",
+            request_metrics_.audio_ms.load(std::memory_order_relaxed) / 1e3);
+  w.Counter("asr_vad_frames_total", "Windows run through the vad",
+            silero_vad::SileroVAD::frames_total().load(
+                std::memory_order_relaxed));
+  w.Counter("asr_trim_input_seconds_total", "Audio before silence trimming",
+            trim_metrics_.input_ms.load(std::memory_order_relaxed) / 1e3);
+  w.Counter("asr_trim_kept_seconds_total", "Audio after silence trimming",
+            trim_metrics_.kept_ms.load(std::memory_order_relaxed) / 1e3);
+  if (auto *cache = _batch_sense_voice->cache()) {
+    auto &m = cache->metrics();
+    w.Counter("asr_cache_hits_total", "Transcript cache hits",
+              m.hits.load(std::memory_order_relaxed));
+    w.Counter("asr_cache_misses_total", "Transcript cache misses",
+              m.misses.load(std::memory_order_relaxed));
+    w.Gauge("asr_cache_bytes", "Memory charged to the transcript cache",
+            m.bytes.load(std::memory_order_relaxed));
+  }
+  return w.str();
 }
 
-void OfflineWebsocketServer::Run(uint16_t port) {
+void OfflineWebsocketServer::RunLocal(const std::string &path) {
+  try {
+    local_ = std::make_unique<LocalListener>(
+        path, [this](LocalListener::Request &&req) {
+          OnLocalRequest(std::move(req));
+        });
+  } catch (const std::exception &e) {
+    // the websocket server is still up, serve without the local transport
+    PLOGE << "Local transport disabled: " << e.what();
+  }
+}
+
+void OfflineWebsocketServer::Run(uint16_t port, bool reuse_port) {
   server_.set_reuse_addr(true);
+  if (reuse_port) {
+    server_.set_tcp_pre_bind_handler([](auto acceptor) {
+      int one = 1;
+      websocketpp::lib::error_code ec;
+      if (setsockopt(acceptor->native_handle(), SOL_SOCKET, SO_REUSEPORT, &one,
+                     sizeof(one)) != 0) {
+        ec = websocketpp::lib::error_code(errno, std::system_category());
+      }
+      return ec;
+    });
+  }
   server_.listen(asio::ip::tcp::v4(), port);
   server_.start_accept();
 }
@@ -5,52 +5,212 @@
     > Created Time: 2025年07月21日 星期一 15时57分12秒
  ************************************************************************/
 #pragma once
+#include "audio_buffer.h"
 #include "batch_sense_voice.h"
 #include "clog.h"
+#include "local_transport.h"
+#include "pipeline.h"
+#include "resample.h"
+#include "sample_format.h"
 #include "sense_voice.h"
+#include "silence_trimmer.h"
+#include "trace.h"
 #include "util.h"
+#include "vad_segmenter.h"
+#include "config.h"
+#include <atomic>
+#include <map>
 #include <memory>
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
 
-typedef websocketpp::server<websocketpp::config::asio> server;
 using websocketpp::connection_hdl;
 using websocketpp::lib::bind;
 using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 
-struct ConnectionData {
+// One upload in progress. The io thread appends samples to audio, the
+// features stage computes fbank/LFR from the prefix that has arrived.
+// Requests of the local transport are uploads whose samples already sit in
+// the client's shared memory.
+//
+// Uploads longer than CONFIG::max_utterance_length are segmented instead:
+// the io thread hands over the samples in chunks, the features stage runs
+// them through a VadSegmenter and every speech segment becomes a request
+// of its own. Results go back as one JSON message per segment, in order,
+// followed by {"done": true, "segments": n}.
+struct Upload {
+  // Payload samples are decoded straight into it, in the int16 range; the
+  // buffer comes from AudioBufferPool and features are computed from it in
+  // place.
+  std::shared_ptr<AudioBuffer> audio;
+  // where the features stage reads the samples: audio->data(), or the
+  // client's ring for local requests, kept mapped by mapping
+  const float *samples = nullptr;
+  std::shared_ptr<const void> mapping;
+
+  // Sends a result to the client, last is set on its final message. May be
+  // called from any thread.
+  std::function<void(const std::string &text, bool last)> reply;
+
+  // guards everything below, taken by the features stage only
+  std::mutex mx;
+  std::unique_ptr<OnlineSenseVoiceFeature> feature;
+  // set if the client's rate is not CONFIG::asr_sample_rate
+  std::unique_ptr<sherpa_onnx::LinearResample> resampler;
+  std::vector<float> resampled;
+  std::unique_ptr<SilenceTrimmer> trimmer; // if CONFIG::trim_silence
+  std::unique_ptr<SampleHasher> hasher;    // if the transcript cache is on
+  int32_t fed = 0; // samples passed to feature (or resampler)
+  bool submitted = false;
+  int32_t sample_rate = 0; // of samples
+  double duration = 0;      // seconds of audio
+  // when the first and the last sample arrived, for metrics and tracing
+  std::chrono::steady_clock::time_point begin;
+  std::chrono::steady_clock::time_point complete;
+  uint64_t trace_id = 0;
+  bool timings = false; // the result carries the stage timings
+
+  // Drops the audio and the front end once the features are taken
+  void ReleaseInput() {
+    feature.reset();
+    resampler.reset();
+    trimmer.reset();
+    samples = nullptr;
+    audio.reset();
+    mapping.reset();
+  }
+
+  // the client's request id on a multiplexed connection, -1 otherwise
+  int64_t id = -1;
+
+  // segmented uploads only
+  bool segmented = false;
+  std::unique_ptr<VadSegmenter> segmenter;
+  using Chunk = std::shared_ptr<std::vector<float>>;
+  std::map<int32_t, std::pair<Chunk, bool>> chunks; // arrived out of order
+  int32_t next_chunk = 0;
+
+  // results of a segmented upload, delivered in segment order
+  std::mutex result_mx;
+  std::map<int32_t, std::string> results;
+  int32_t next_result = 0;
+  int32_t num_segments = -1; // known once all audio went through the vad
+  bool done_sent = false;
+};
+using UploadPtr = std::shared_ptr<Upload>;
+
+// Every upload starts with an 8 byte header: int32 sample rate, whose top
+// byte is the SampleFormat (0 for float32, so old clients keep working),
+// and int32 number of sample bytes that follow. The samples may be split
+// over any number of binary frames.
+//
+// UploadStream is the receive state of one such upload.
+struct UploadStream {
   // Sample rate of the audio samples the client
   int32_t sample_rate;
 
+  SampleFormat format = SampleFormat::kFloat32;
+
   // Number of expected bytes sent from the client
   int32_t expected_byte_size = 0;
 
   // Number of bytes received so far
   int32_t cur = 0;
 
-  // It saves the received samples from the client.
-  // We will **reinterpret_cast** it to float.
-  // We expect that data.size() == expected_byte_size
-  std::vector<int8_t> data;
+  // Samples decoded into upload->audio (or chunk) so far
+  int32_t num_samples = 0;
+
+  // Samples received when the features stage was last given work
+  int32_t posted = 0;
+
+  // bytes of a sample split across two frames
+  uint8_t partial[4];
+  int32_t num_partial = 0;
+
+  UploadPtr upload;
+
+  // segmented uploads: samples not yet handed to the features stage
+  std::vector<float> chunk;
+  int32_t num_chunks = 0;
+
+  // Decodes payload bytes into upload->audio (or chunk)
+  void Append(const uint8_t *p, int32_t n);
 
   void Clear() {
     sample_rate = 0;
+    format = SampleFormat::kFloat32;
     expected_byte_size = 0;
     cur = 0;
-    data.clear();
+    num_samples = 0;
+    posted = 0;
+    num_partial = 0;
+    upload.reset();
+    chunk.clear();
+    num_chunks = 0;
   }
 };
-using ConnectionDataPtr = std::shared_ptr<ConnectionData>;
+
+// A connection carries one upload at a time, or, if the very first binary
+// frame starts with a word that has its top bit set, it is multiplexed for
+// its lifetime: every binary frame is then prefixed with a uint32
+// 0x80000000 | request_id, frames of different requests may interleave and
+// each request id runs its own upload stream. Results on a multiplexed
+// connection are JSON tagged with "id" and come back in completion order.
+struct ConnectionData {
+  enum class Mode { kUnknown, kSingle, kMultiplexed };
+  Mode mode = Mode::kUnknown;
+  // Connected as ws://host:port/?timings=1: every result is JSON with the
+  // milliseconds its request spent per stage and the id to look it up in
+  // GET /trace, {"text", "trace", "timings"}
+  bool timings = false;
+
+  UploadStream single;
+  std::map<uint32_t, UploadStream> streams; // by request id
+};
+
+// Base class of every websocketpp connection, so the per-connection state
+// is reached from the handle without a server wide registry or lock.
+// data is only touched by the handlers of the connection, which websocketpp
+// runs on the connection's strand; open is read by the decode stage.
+struct ConnectionBase {
+  ConnectionData data;
+  std::atomic<bool> open{false};
+};
+
+// websocketpp::config::asio with ConnectionBase as the connection base
+struct ServerConfig : public websocketpp::config::asio {
+  typedef websocketpp::config::asio core;
+
+  typedef core::concurrency_type concurrency_type;
+  typedef core::request_type request_type;
+  typedef core::response_type response_type;
+  typedef core::message_type message_type;
+  typedef core::con_msg_manager_type con_msg_manager_type;
+  typedef core::endpoint_msg_manager_type endpoint_msg_manager_type;
+  typedef core::alog_type alog_type;
+  typedef core::elog_type elog_type;
+  typedef core::rng_type rng_type;
+  typedef core::transport_type transport_type;
+  typedef core::endpoint_base endpoint_base;
+
+  typedef ConnectionBase connection_base;
+};
+typedef websocketpp::server<ServerConfig> server;
 
 class OfflineWebsocketServer {
 public:
-  OfflineWebsocketServer(asio::io_context &io_conn, asio::io_context &io_work);
+  explicit OfflineWebsocketServer(asio::io_context &io_conn);
   ~OfflineWebsocketServer();
 
   server &GetServer() { return server_; }
 
-  void Run(uint16_t port);
+  // With reuse_port, several processes can listen on port and the kernel
+  // spreads the connections over them (prefork mode)
+  void Run(uint16_t port, bool reuse_port = false);
+
+  // Also serve local clients on a unix socket at path
+  void RunLocal(const std::string &path);
 
 private:
   // When a websocket client is connected, it will invoke this method
@@ -62,23 +222,67 @@ private:
 
   void OnMessage(connection_hdl hdl, server::message_ptr msg);
 
+  // Plain HTTP requests on the websocket port: GET /metrics, and
+  // GET /trace[?request=id] for a Chrome/Perfetto trace of recent requests
+  void OnHttp(connection_hdl hdl);
+  std::string RenderMetrics();
+
+  // Payload bytes of one upload stream. Returns false if the connection
+  // was closed because of them.
+  bool Receive(connection_hdl hdl, UploadStream &s, int64_t id,
+               const uint8_t *p, int32_t n);
+
+  // An upload of num_samples at sample_rate with its front end (or vad
+  // segmenter) and resampler, but no audio buffer yet
+  UploadPtr NewUpload(int64_t num_samples, int32_t sample_rate);
+
+  // A request of a local client, see local_transport.h
+  void OnLocalRequest(LocalListener::Request &&req);
+
+  // features stage: the first num_samples samples of the upload have
+  // arrived -> fbank/lfr; once finished, the request goes to the engine
+  void ExtractFeatures(UploadPtr upload, int32_t num_samples, bool finished);
+
+  // features stage of a segmented upload: the seq-th chunk of samples
+  void ExtractSegments(UploadPtr upload, int32_t seq, Upload::Chunk chunk,
+                       bool finished);
+
+  // features -> inference -> decode stage, on_text runs on the decode stage
+  void Submit(std::vector<float> &&feats, uint64_t trace_id,
+              std::function<void(const std::string &)> on_text);
+
+  // The transcript of a whole (not segmented) upload
+  void SendResult(Upload &upload, const std::string &text);
+
+  // Sends the results of a segmented upload that are next in order
+  void DeliverSegments(Upload &upload);
+
   // Close a websocket connection with given code and reason
   void Close(connection_hdl hdl, websocketpp::close::status::value code,
              const std::string &reason);
 
+  // Safe from any thread, a no-op once the connection has closed
   void Send(connection_hdl hdl, const std::string &text);
 
-  bool Contains(connection_hdl hdl);
-
 private:
   server server_;
 
-  std::map<connection_hdl, ConnectionDataPtr, std::owner_less<connection_hdl>>
-      connections_;
-  std::mutex mutex_;
+  std::atomic<int32_t> num_connections_{0};
 
   std::unique_ptr<BatchSenseVoice> _batch_sense_voice;
   // std::unique_ptr<SenseVoice> _batch_sense_voice;
   asio::io_context &io_conn_;
-  asio::io_context &io_work_;
+
+  // Each utterance goes receive (io threads) -> features_ -> inference
+  // (OnnxSession threads, capped by inflight_) -> decode_, so features of
+  // the next utterances overlap with encoder runs.
+  StageMetrics receive_metrics_{"receive", CONFIG::num_io_threads};
+  TrimMetrics trim_metrics_;
+  RequestMetrics request_metrics_;
+  InflightLimiter inflight_{CONFIG::max_inflight_requests};
+  std::unique_ptr<Stage> features_;
+  std::unique_ptr<Stage> decode_;
+  std::unique_ptr<StageReporter> reporter_;
+
+  std::unique_ptr<LocalListener> local_; // stopped before the stages
 };